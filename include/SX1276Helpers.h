@@ -73,6 +73,33 @@ namespace Radio {
         uint8_t     Exp;
     };
 
+    struct Frf {
+        uint8_t     bytes[3];   // REG_FRFMSB, REG_FRFMID, REG_FRFLSB
+    };
+
+    struct RegWrite {
+        uint8_t     addr;
+        uint8_t     value;
+    };
+
+    // Values the driver always runs with, so mode changes need no read-modify-write
+    constexpr uint8_t OPMODE_FSK = RF_OPMODE_LONGRANGEMODE_OFF | RF_OPMODE_MODULATIONTYPE_FSK; // LowFrequencyModeOn off
+    constexpr uint8_t SYNCCONFIG_BASE =
+        RF_SYNCCONFIG_AUTORESTARTRXMODE_WAITPLL_OFF | RF_SYNCCONFIG_PREAMBLEPOLARITY_AA | RF_SYNCCONFIG_SYNC_ON;
+
+    // Register scripts, each run in a single SPI bus transaction
+    constexpr RegWrite SCRIPT_STANDBY[] = {
+        {REG_OPMODE, OPMODE_FSK | RF_OPMODE_STANDBY}
+    };
+    constexpr RegWrite SCRIPT_TX[] = {
+        {REG_SYNCCONFIG, SYNCCONFIG_BASE | RF_SYNCCONFIG_SYNCSIZE_2},   // Sync word size must be 2 in TX
+        {REG_OPMODE, OPMODE_FSK | RF_OPMODE_TRANSMITTER}
+    };
+    constexpr RegWrite SCRIPT_RX[] = {
+        {REG_SYNCCONFIG, SYNCCONFIG_BASE | RF_SYNCCONFIG_SYNCSIZE_3},
+        {REG_OPMODE, OPMODE_FSK | RF_OPMODE_RECEIVER}
+    };
+
     void initHardware();
     void initRegisters(uint8_t maxPayloadLength);
     void calibrate();
@@ -93,6 +120,15 @@ namespace Radio {
     bool inStdbyOrSleep();
     bool setParams();
     bool setCarrier(Carrier param, uint32_t value);
+    Frf frfFor(uint32_t frequency);
+    void setFrequency(const Frf &frf);
+    void invalidateShadow();
+    void runScript(const RegWrite *script, uint8_t len);
+    template <uint8_t N>
+    void runScript(const RegWrite (&script)[N]) { runScript(script, N); }
+    void startTx(const Frf &frf, uint16_t preambleLen, const uint8_t *frame, uint8_t len);
+    void benchSpi(uint16_t rounds);
+    void dumpShadowStats();
     regBandWidth bwRegs(uint8_t bandwidth);
     void dump();
     void dumpReal();
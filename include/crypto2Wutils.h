@@ -27,8 +27,6 @@ inline uint8_t system_key[16] = {0xCE, 0x0D, 0x4B, 0x2F, 0x5C, 0x68, 0x24, 0x93,
 inline uint8_t transfert_key[16] = {0x34, 0xc3, 0x46, 0x6e, 0xd8, 0x8f, 0x4e, 0x8e, 0x16, 0xaa, 0x47, 0x39, 0x49, 0x88, 0x43, 0x73};
 inline uint8_t setgo[16] = {0x9A, 0x00, 0x72, 0x1E, 0x3E, 0xE2, 0x9A, 0x7B, 0xF1, 0xB4, 0xA6, 0x08, 0x6C, 0x14, 0x52, 0xEB};
 
-inline AES_ctx ctx; // RadioLibAES128 aes;
-
 typedef struct {
     uint8_t chksum1;
     uint8_t chksum2;
@@ -0,0 +1,67 @@
+/*
+   Copyright (c) 2024. CRIDP https://github.com/cridp
+
+   Licensed under the Apache License, Version 2.0 (the "License");
+   you may not use this file except in compliance with the License.
+   You may obtain a copy of the License at
+
+           http://www.apache.org/licenses/LICENSE-2.0
+
+   Unless required by applicable law or agreed to in writing, software
+   distributed under the License is distributed on an "AS IS" BASIS,
+   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+   See the License for the specific language governing permissions and
+   limitations under the License.
+ */
+
+#ifndef IOHC_CARRIER_SENSE_H
+#define IOHC_CARRIER_SENSE_H
+
+#include <cstdint>
+
+#define LBT_DEFAULT_THRESHOLD_DBM   (-90)   // Channel busy when RSSI reaches this level
+#define LBT_DEFAULT_WINDOW_US       1000    // Listening time before a transmission
+#define LBT_MAX_WINDOW_US           5000    // Longest window accepted by configure()
+#define LBT_SETTLE_US               600     // RX startup and RSSI smoothing (8 samples) before sampling
+#define LBT_SAMPLE_US               100     // RSSI sampling period, each sample is a timer callback
+#define LBT_BACKOFF_MIN_MS          10      // First back-off drawn in [min, 2 x min)
+#define LBT_BACKOFF_MAX_MS          160     // Back-off range cap, doubles with every attempt until there
+#define LBT_MAX_BACKOFFS            5       // Attempts before the packet is sent anyway
+
+namespace IOHC {
+    /**
+     * Listen-before-talk: samples the RSSI of the TX channel for a short window, with the receiver
+     * already tuned and in RX, and draws jittered back-off delays when the channel is busy. Sampling
+     * never blocks: the caller takes one sample every LBT_SAMPLE_US from a timer until a verdict.
+     */
+    class iohcCarrierSense {
+    public:
+        enum class Verdict : uint8_t {
+            Listening,      ///< Window not over yet, sample again in LBT_SAMPLE_US
+            Clear,
+            Busy
+        };
+
+        void configure(bool enable, int16_t thresholdDbm, uint16_t windowUs);
+        bool isEnabled() const { return enabled; }
+
+        void begin();
+        Verdict sample();
+        uint32_t backoffMs(uint8_t attempt);
+        void onForced() { forced++; }
+        void dump() const;
+
+    private:
+        bool enabled = false;
+        int16_t threshold = LBT_DEFAULT_THRESHOLD_DBM;
+        uint16_t window = LBT_DEFAULT_WINDOW_US;
+        int16_t lastPeak = -128;
+        int16_t peak = -128;
+        int64_t startUs = 0;
+        uint32_t checks = 0;
+        uint32_t busy = 0;
+        uint32_t backoffs = 0;
+        uint32_t forced = 0;
+    };
+}
+#endif
@@ -25,21 +25,25 @@
 #if defined(ESP8266)
     #include <Crypto.h>
     #include <AES.h>
-    #include <CTR.h>
 #elif defined(ESP32)
     #include "mbedtls/aes.h"        // AES functions
 #endif
 
 #define CRC_POLYNOMIAL_CCITT    0x8408
+#define MAX_CRC_FRAME_LEN       34      // Largest frame (32 bytes) and its CRC
 
 uint8_t hexStringToBytes(std::string hexString, uint8_t *byteString);
 std::string bytesToHexString(const uint8_t *byteString, uint8_t len);
 
 namespace iohcCrypto {
     uint16_t computeCrc(uint8_t data, uint16_t crc);
-    uint16_t radioPacketComputeCrc(uint8_t *buffer, uint8_t bufferLength);
-    uint16_t radioPacketComputeCrc(std::vector<uint8_t>& buffer);
+    uint16_t radioPacketComputeCrc(const uint8_t *buffer, size_t length, uint16_t crc = 0);
+    void benchCrc(uint16_t rounds);
+    void aes128Encrypt(const uint8_t *key, const uint8_t *in, uint8_t *out);
+    bool aesSelfTest();
+    void benchAes(uint16_t rounds);
     void encrypt_1W_key(const uint8_t *node_address, uint8_t *key);
+    void create_1W_hmac(uint8_t *hmac, const uint8_t *seq_number, const uint8_t *controller_key, const uint8_t *frame_data, size_t length);
     void create_1W_hmac(uint8_t *hmac, const uint8_t *seq_number, uint8_t *controller_key, const std::vector<uint8_t>& frame_data);
 }
 #endif
\ No newline at end of file
@@ -0,0 +1,60 @@
+/*
+   Copyright (c) 2024. CRIDP https://github.com/cridp
+
+   Licensed under the Apache License, Version 2.0 (the "License");
+   you may not use this file except in compliance with the License.
+   You may obtain a copy of the License at
+
+           http://www.apache.org/licenses/LICENSE-2.0
+
+   Unless required by applicable law or agreed to in writing, software
+   distributed under the License is distributed on an "AS IS" BASIS,
+   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+   See the License for the specific language governing permissions and
+   limitations under the License.
+ */
+
+#ifndef IOHC_DEDUP_CACHE_H
+#define IOHC_DEDUP_CACHE_H
+
+#include <cstdint>
+
+#include <iohcPacket.h>
+
+#define DEDUP_CACHE_ENTRIES         16      // Distinct 1W frames remembered at once
+#define DEDUP_DEFAULT_WINDOW_MS     1000    // Repeats of a frame within this window are not dispatched again
+#define DEDUP_KEY_TAIL_LEN          8       // Trailing bytes of a 1W frame: sequence (2) + MAC (6)
+
+namespace IOHC {
+    /**
+     * Small fixed-size cache recognising the repeats of a 1W frame (same source, cmd, sequence and MAC)
+     * so only the first copy reaches the receive callback. 2W frames are never suppressed as a device
+     * retry must still be answered. A window of 0 delivers every copy, for sniffing.
+     */
+    class iohcDedupCache {
+    public:
+        void begin();
+        void setWindowMs(uint16_t windowMs);
+        uint16_t windowMs() const { return window; }
+
+        bool isDuplicate(const iohcPacket *packet);
+        void dump() const;
+
+    private:
+        struct entry {
+            bool used;
+            address source;
+            uint8_t cmd;
+            uint8_t tailLen;
+            uint8_t tail[DEDUP_KEY_TAIL_LEN];
+            unsigned long firstSeen;
+            uint16_t repeats;
+        };
+
+        entry entries[DEDUP_CACHE_ENTRIES]{};
+        uint16_t window = DEDUP_DEFAULT_WINDOW_MS;
+        uint32_t delivered = 0;
+        uint32_t suppressed = 0;
+    };
+}
+#endif
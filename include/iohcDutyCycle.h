@@ -0,0 +1,62 @@
+/*
+   Copyright (c) 2024. CRIDP https://github.com/cridp
+
+   Licensed under the Apache License, Version 2.0 (the "License");
+   you may not use this file except in compliance with the License.
+   You may obtain a copy of the License at
+
+           http://www.apache.org/licenses/LICENSE-2.0
+
+   Unless required by applicable law or agreed to in writing, software
+   distributed under the License is distributed on an "AS IS" BASIS,
+   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+   See the License for the specific language governing permissions and
+   limitations under the License.
+ */
+
+#ifndef IOHC_DUTY_CYCLE_H
+#define IOHC_DUTY_CYCLE_H
+
+#include "freertos/FreeRTOS.h"
+
+#include <ArduinoJson.h>
+#include <cstdint>
+
+#define DUTY_BANDS              4           // 868.0-868.6, 868.7-869.2, 869.7-870.0, anything else
+#define DUTY_BINS               60          // Rolling hour split in one minute bins
+#define DUTY_BIN_US             60000000LL
+#define DUTY_LOW_PERCENT        20          // Background traffic is deferred below this share of budget left
+#define DUTY_RETRY_MS           5000        // Deferred background traffic is retried this often
+#define DUTY_SYNC_BYTES         3
+#define DUTY_CRC_BYTES          2
+#define DUTY_BITS_PER_BYTE      10          // IoHome UART framing: start + 8 data + stop bits
+
+namespace IOHC {
+    /**
+     * Airtime accounting per 868 MHz sub-band (ERC 70-03 duty-cycle limits) over a rolling hour,
+     * fed by every transmission. The TX scheduler asks it whether background traffic may go.
+     */
+    class iohcDutyCycle {
+    public:
+        static uint32_t airtimeUs(uint16_t preambleBytes, uint8_t length, uint32_t bitrate);
+
+        void record(uint32_t frequency, uint32_t airtimeUs);
+        bool isLow(uint32_t frequency);
+        void onDeferred() { deferred++; }
+
+        void toJson(JsonArray &root);
+        void dump();
+
+    private:
+        static uint8_t bandOf(uint32_t frequency);
+        void advance(int64_t nowUs);
+        uint32_t usedUs(uint8_t band) const;
+
+        portMUX_TYPE mux = portMUX_INITIALIZER_UNLOCKED;
+        uint32_t bins[DUTY_BANDS][DUTY_BINS]{};
+        int64_t currentMinute = 0;
+        uint8_t currentBin = 0;
+        uint32_t deferred = 0;
+    };
+}
+#endif
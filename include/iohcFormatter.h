@@ -0,0 +1,62 @@
+/*
+   Copyright (c) 2024. CRIDP https://github.com/cridp
+
+   Licensed under the Apache License, Version 2.0 (the "License");
+   you may not use this file except in compliance with the License.
+   You may obtain a copy of the License at
+
+           http://www.apache.org/licenses/LICENSE-2.0
+
+   Unless required by applicable law or agreed to in writing, software
+   distributed under the License is distributed on an "AS IS" BASIS,
+   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+   See the License for the specific language governing permissions and
+   limitations under the License.
+ */
+
+
+#ifndef IOHC_FORMATTER_H
+#define IOHC_FORMATTER_H
+
+#include <cstddef>
+#include <cstdint>
+
+#define IOHC_DECODE_LINE_LEN    320     // Console decode line of a frame
+#define IOHC_SUMMARY_LEN        128     // Log buffer, syslog and web line of a frame
+
+namespace IOHC {
+    /**
+     * Table driven hex encoding of `len` bytes, two digits each, no terminator.
+     *
+     * @return The number of characters written, 2 x `len`.
+     */
+    size_t hexEncode(char *out, const uint8_t *data, size_t len, bool upper = false);
+
+    /**
+     * Appends text to a caller-provided buffer without allocating. Output beyond the buffer is dropped
+     * and the text always stays NUL terminated.
+     */
+    class iohcFormatter {
+    public:
+        iohcFormatter(char *out, size_t size);
+
+        iohcFormatter &str(const char *s);
+        iohcFormatter &chr(char c);
+        iohcFormatter &hex(const uint8_t *data, size_t len, bool upper = false);
+        iohcFormatter &hex(uint32_t value, uint8_t width = 0);          // %X, space padded to `width`
+        iohcFormatter &hex2(uint8_t value);                             // %2.2X
+        iohcFormatter &dec(uint32_t value, uint8_t width = 0, char fill = ' ');
+        iohcFormatter &usAsMs(uint32_t us);                             // %.3f of us / 1000
+
+        size_t length() const { return len; }
+        const char *c_str() const { return out; }
+        bool truncated() const { return overflow; }
+
+    private:
+        char *out;
+        size_t size;
+        size_t len = 0;
+        bool overflow = false;
+    };
+}
+#endif
@@ -0,0 +1,71 @@
+/*
+   Copyright (c) 2024. CRIDP https://github.com/cridp
+
+   Licensed under the Apache License, Version 2.0 (the "License");
+   you may not use this file except in compliance with the License.
+   You may obtain a copy of the License at
+
+           http://www.apache.org/licenses/LICENSE-2.0
+
+   Unless required by applicable law or agreed to in writing, software
+   distributed under the License is distributed on an "AS IS" BASIS,
+   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+   See the License for the specific language governing permissions and
+   limitations under the License.
+ */
+
+
+#ifndef IOHC_FRAME_BUILDER_H
+#define IOHC_FRAME_BUILDER_H
+
+#include <cstddef>
+#include <cstdint>
+
+#include <iohcPacket.h>
+#include <iohcFrameLayout.h>
+
+#define IOHC_1W_MAC_LEN         6       // Truncated HMAC closing a 1W frame
+
+namespace IOHC {
+    /**
+     * Writes a frame straight into a (pooled) packet: header first, then the data bytes in order.
+     * MsgLen and buffer_length follow every append, data that would not fit in a frame is dropped.
+     * Nothing is allocated, the 1W MAC is computed over the bytes already in the packet. Frames of a known
+     * command variant take their command, length and field offsets from the frame layout table.
+     */
+    class iohcFrameBuilder {
+    public:
+        iohcFrameBuilder(iohcPacket *packet, bool oneWay);
+        explicit iohcFrameBuilder(iohcPacket *packet);                 // Keeps the control bytes already set
+
+        iohcFrameBuilder &endFrame(bool end);
+        iohcFrameBuilder &lowPower(bool lpm);
+        iohcFrameBuilder &priority(bool prio);
+        iohcFrameBuilder &target(const address node);
+        iohcFrameBuilder &broadcast(uint16_t group);                    // Target 00 + group
+        iohcFrameBuilder &source(const address node);
+        iohcFrameBuilder &command(uint8_t cmd);
+        iohcFrameBuilder &layout(FrameLayoutId id);                     // Command and data up to the sequence of a layout
+        iohcFrameBuilder &field(FrameField field, uint32_t value);      // Numeric field of that layout, big endian
+
+        iohcFrameBuilder &byte(uint8_t value);
+        iohcFrameBuilder &word(uint16_t value);                         // Big endian as on air
+        iohcFrameBuilder &bytes(const uint8_t *data, size_t len);
+        iohcFrameBuilder &extend(size_t len);                           // Data already written through the payload structs
+        iohcFrameBuilder &sign1W(uint16_t sequence, const uint8_t *key);  // Sequence then MAC over command and data
+
+        iohcPacket *packet() const { return frame; }
+        size_t dataLength() const { return dataLen; }
+        bool truncated() const { return overflow; }                    // Data dropped, or a field not in the layout
+
+    private:
+        uint8_t *reserve(size_t len);
+
+        iohcPacket *frame;
+        size_t dataLen = 0;
+        bool overflow = false;
+        bool hasLayout = false;
+        FrameLayoutId layoutId{};
+    };
+}
+#endif
@@ -0,0 +1,175 @@
+/*
+   Copyright (c) 2024. CRIDP https://github.com/cridp
+
+   Licensed under the Apache License, Version 2.0 (the "License");
+   you may not use this file except in compliance with the License.
+   You may obtain a copy of the License at
+
+           http://www.apache.org/licenses/LICENSE-2.0
+
+   Unless required by applicable law or agreed to in writing, software
+   distributed under the License is distributed on an "AS IS" BASIS,
+   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+   See the License for the specific language governing permissions and
+   limitations under the License.
+ */
+
+
+#ifndef IOHC_FRAME_LAYOUT_H
+#define IOHC_FRAME_LAYOUT_H
+
+#include <cstddef>
+#include <cstdint>
+
+#include <iohcPacket.h>
+
+#define IOHC_HEADER_LEN         9       // CtrlByte1, CtrlByte2, target, source, cmd
+#define LAYOUT_ACEI_BITS        0x01    // Decode also prints the ACEI level, service, extended and valid bits
+#define LAYOUT_ANY_LEN          0x02    // Applies to any data length from the listed one, fields cover its start
+
+/*
+    Fields of each payload struct, in frame order: F(struct, member, FrameField)
+*/
+#define IOHC_FIELDS_p0x01_13(F) \
+    F(_p0x01_13, origin, Origin) F(_p0x01_13, acei, Acei) F(_p0x01_13, main, Main) F(_p0x01_13, fp1, Fp1) \
+    F(_p0x01_13, fp2, Fp2) F(_p0x01_13, sequence, Sequence) F(_p0x01_13, hmac, Hmac)
+#define IOHC_FIELDS_p0x01_2W(F) \
+    F(_p0x01_13, origin, Origin) F(_p0x01_13, acei, Acei) F(_p0x01_13, main, Main) F(_p0x01_13, fp1, Fp1) \
+    F(_p0x01_13, fp2, Fp2)
+#define IOHC_FIELDS_p0x00_14(F) \
+    F(_p0x00_14, origin, Origin) F(_p0x00_14, acei, Acei) F(_p0x00_14, main, Main) F(_p0x00_14, fp1, Fp1) \
+    F(_p0x00_14, fp2, Fp2) F(_p0x00_14, sequence, Sequence) F(_p0x00_14, hmac, Hmac)
+#define IOHC_FIELDS_p0x00_16(F) \
+    F(_p0x00_16, origin, Origin) F(_p0x00_16, acei, Acei) F(_p0x00_16, main, Main) F(_p0x00_16, fp1, Fp1) \
+    F(_p0x00_16, fp2, Fp2) F(_p0x00_16, data, Data) F(_p0x00_16, sequence, Sequence) F(_p0x00_16, hmac, Hmac)
+#define IOHC_FIELDS_p0x20_13(F) \
+    F(_p0x20_13, origin, Origin) F(_p0x20_13, acei, Acei) F(_p0x20_13, main, Main) F(_p0x20_13, fp1, Fp1) \
+    F(_p0x20_13, sequence, Sequence) F(_p0x20_13, hmac, Hmac)
+#define IOHC_FIELDS_p0x20_15(F) \
+    F(_p0x20_15, origin, Origin) F(_p0x20_15, acei, Acei) F(_p0x20_15, main, Main) F(_p0x20_15, fp1, Fp1) \
+    F(_p0x20_15, fp2, Fp2) F(_p0x20_15, fp3, Fp3) F(_p0x20_15, sequence, Sequence) F(_p0x20_15, hmac, Hmac)
+#define IOHC_FIELDS_p0x20_16(F) \
+    F(_p0x20_16, origin, Origin) F(_p0x20_16, acei, Acei) F(_p0x20_16, main, Main) F(_p0x20_16, fp1, Fp1) \
+    F(_p0x20_16, fp2, Fp2) F(_p0x20_16, data, Data) F(_p0x20_16, sequence, Sequence) F(_p0x20_16, hmac, Hmac)
+#define IOHC_FIELDS_p0x2b(F) \
+    F(_p0x2b, actuator, Actuator) F(_p0x2b, backbone, Backbone) F(_p0x2b, manufacturer, ManId) \
+    F(_p0x2b, info, Info) F(_p0x2b, tstamp, Timestamp)
+#define IOHC_FIELDS_p0x2e(F) \
+    F(_p0x2e, data, Data) F(_p0x2e, sequence, Sequence) F(_p0x2e, hmac, Hmac)
+#define IOHC_FIELDS_p0x30(F) \
+    F(_p0x30, enc_key, EncKey) F(_p0x30, man_id, ManId) F(_p0x30, data, Data) F(_p0x30, sequence, Sequence)
+
+/*
+    Every known command variant, one line each: X(id, 1W, cmd, data length, struct, fields, flags)
+    The first match of protocol, command and length wins.
+*/
+#define IOHC_FRAME_LAYOUTS(X) \
+    X(Execute1W13,      true,  0x00, 13, _p0x01_13, IOHC_FIELDS_p0x01_13, LAYOUT_ACEI_BITS) \
+    X(Execute1W14,      true,  0x00, 14, _p0x00_14, IOHC_FIELDS_p0x00_14, LAYOUT_ACEI_BITS) \
+    X(Execute1W16,      true,  0x00, 16, _p0x00_16, IOHC_FIELDS_p0x00_16, LAYOUT_ACEI_BITS) \
+    X(Activate1W13,     true,  0x01, 13, _p0x01_13, IOHC_FIELDS_p0x01_13, LAYOUT_ACEI_BITS) \
+    X(Activate1W14,     true,  0x01, 14, _p0x00_14, IOHC_FIELDS_p0x00_14, LAYOUT_ACEI_BITS) \
+    X(Activate1W16,     true,  0x01, 16, _p0x00_16, IOHC_FIELDS_p0x00_16, LAYOUT_ACEI_BITS) \
+    X(Private1W13,      true,  0x20, 13, _p0x20_13, IOHC_FIELDS_p0x20_13, 0) \
+    X(Private1W15,      true,  0x20, 15, _p0x20_15, IOHC_FIELDS_p0x20_15, 0) \
+    X(Private1W16,      true,  0x20, 16, _p0x20_16, IOHC_FIELDS_p0x20_16, 0) \
+    X(Discover1W13,     true,  0x28, 13, _p0x01_13, IOHC_FIELDS_p0x01_13, LAYOUT_ACEI_BITS) \
+    X(Discover1W14,     true,  0x28, 14, _p0x00_14, IOHC_FIELDS_p0x00_14, LAYOUT_ACEI_BITS) \
+    X(Discover1W16,     true,  0x28, 16, _p0x00_16, IOHC_FIELDS_p0x00_16, LAYOUT_ACEI_BITS) \
+    X(Pair1W,           true,  0x2e,  9, _p0x2e,    IOHC_FIELDS_p0x2e,    0) \
+    X(Unpair1W,         true,  0x39,  9, _p0x2e,    IOHC_FIELDS_p0x2e,    0) \
+    X(AddKey1W,         true,  0x30, 20, _p0x30,    IOHC_FIELDS_p0x30,    0) \
+    X(DiscoverAnswer2W, false, 0x29,  9, _p0x2b,    IOHC_FIELDS_p0x2b,    0) \
+    X(DiscoverRemote2W, false, 0x2b,  9, _p0x2b,    IOHC_FIELDS_p0x2b,    0) \
+    X(Execute2W,        false, 0x00,  5, _p0x01_13, IOHC_FIELDS_p0x01_2W, LAYOUT_ACEI_BITS | LAYOUT_ANY_LEN) \
+    X(Activate2W,       false, 0x01,  5, _p0x01_13, IOHC_FIELDS_p0x01_2W, LAYOUT_ACEI_BITS | LAYOUT_ANY_LEN)
+
+namespace IOHC {
+    enum class FrameField : uint8_t {
+        Origin, Acei, Main, Fp1, Fp2, Fp3, Data, Sequence, Hmac, EncKey, ManId,
+        Actuator, Backbone, Info, Timestamp,
+        Count
+    };
+
+    struct FrameFieldDesc {
+        FrameField field;
+        uint8_t offset;         // From the first data byte, after the header
+        uint8_t size;
+    };
+
+    struct FrameLayout {
+        bool oneWay;
+        uint8_t cmd;
+        uint8_t dataLen;
+        const FrameFieldDesc *fields;
+        uint8_t fieldCount;
+        uint8_t flags;          // LAYOUT_*
+    };
+
+    enum class FrameLayoutId : uint8_t {
+#define IOHC_LAYOUT_ID(id, oneWay, cmd, len, type, fields, flags) id,
+        IOHC_FRAME_LAYOUTS(IOHC_LAYOUT_ID)
+#undef IOHC_LAYOUT_ID
+        Count
+    };
+
+    namespace frameLayouts {
+#define IOHC_FIELD_DESC(type, member, field) {FrameField::field, offsetof(type, member), sizeof(type::member)},
+#define IOHC_LAYOUT_FIELDS(id, oneWay, cmd, len, type, fields, flags) \
+        constexpr FrameFieldDesc id[] = {fields(IOHC_FIELD_DESC)};
+        IOHC_FRAME_LAYOUTS(IOHC_LAYOUT_FIELDS)
+#undef IOHC_LAYOUT_FIELDS
+#undef IOHC_FIELD_DESC
+    }
+
+    constexpr FrameLayout FRAME_LAYOUTS[] = {
+#define IOHC_LAYOUT_ENTRY(id, oneWay, cmd, len, type, fields, flags) \
+        {oneWay, cmd, len, frameLayouts::id, sizeof(frameLayouts::id) / sizeof(FrameFieldDesc), flags},
+        IOHC_FRAME_LAYOUTS(IOHC_LAYOUT_ENTRY)
+#undef IOHC_LAYOUT_ENTRY
+    };
+
+    constexpr const FrameLayout &frameLayout(FrameLayoutId id) {
+        return FRAME_LAYOUTS[static_cast<uint8_t>(id)];
+    }
+
+    /** The `findFrameDesc` function returns the description of `field` in `layout`, nullptr if it has none. */
+    constexpr const FrameFieldDesc *findFrameDesc(const FrameLayout &layout, FrameField field) {
+        for (uint8_t i = 0; i < layout.fieldCount; i++)
+            if (layout.fields[i].field == field) return &layout.fields[i];
+        return nullptr;
+    }
+
+    /** The `readFrameField` function returns a numeric field, big endian as on air. Fields over 4 bytes are byte strings. */
+    constexpr uint32_t readFrameField(const uint8_t *data, const FrameFieldDesc &desc) {
+        uint32_t value = 0;
+        for (uint8_t i = 0; i < desc.size && i < 4; i++) value = value << 8 | data[desc.offset + i];
+        return value;
+    }
+
+    /** The `writeFrameField` function stores a numeric field of up to 4 bytes, big endian as on air. */
+    constexpr void writeFrameField(uint8_t *data, const FrameFieldDesc &desc, uint32_t value) {
+        for (uint8_t i = desc.size; i > 0; i--) {
+            data[desc.offset + i - 1] = static_cast<uint8_t>(value);
+            value >>= 8;
+        }
+    }
+
+    /** The `layoutIsDense` function checks the fields follow each other and fill the `size` bytes of the struct,
+        or only the `dataLen` first ones of a LAYOUT_ANY_LEN layout. */
+    constexpr bool layoutIsDense(const FrameLayout &layout, size_t size) {
+        size_t next = 0;
+        for (uint8_t i = 0; i < layout.fieldCount; i++) {
+            if (layout.fields[i].offset != next || !layout.fields[i].size) return false;
+            next += layout.fields[i].size;
+        }
+        if (layout.flags & LAYOUT_ANY_LEN) return next == layout.dataLen && next <= size;
+        return next == size && size == layout.dataLen;
+    }
+
+    const FrameLayout *findFrameLayout(bool oneWay, uint8_t cmd, uint8_t dataLen);
+    const FrameLayout *findFrameLayout(const iohcPacket *packet);
+    bool frameField(const iohcPacket *packet, FrameField field, uint32_t &value, uint8_t *size = nullptr);
+    const char *frameFieldName(FrameField field);
+}
+#endif
@@ -0,0 +1,57 @@
+/*
+   Copyright (c) 2024. CRIDP https://github.com/cridp
+
+   Licensed under the Apache License, Version 2.0 (the "License");
+   you may not use this file except in compliance with the License.
+   You may obtain a copy of the License at
+
+           http://www.apache.org/licenses/LICENSE-2.0
+
+   Unless required by applicable law or agreed to in writing, software
+   distributed under the License is distributed on an "AS IS" BASIS,
+   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+   See the License for the specific language governing permissions and
+   limitations under the License.
+ */
+
+#ifndef IOHC_HOP_POLICY_H
+#define IOHC_HOP_POLICY_H
+
+#include <cstdint>
+
+#define HOP_MAX_CHANNELS        4       // Upper bound of scanned frequencies tracked by the policy
+#define HOP_MIN_DWELL_PERCENT   10      // Share of a full hop cycle every channel keeps, even when quiet
+#define HOP_FRAME_WEIGHT        16      // Activity added by a received frame
+#define HOP_PREAMBLE_WEIGHT     4       // Activity added by a detected preamble
+#define HOP_DECAY_SHIFT         3       // Activity loses 1/8, rounded up, at the end of every hop cycle
+
+namespace IOHC {
+    /**
+     * Hopping policy deciding how long the receiver dwells on each scanned channel.
+     * In fixed mode every channel gets the base scan interval. In adaptive mode the full
+     * cycle (base interval x channels) is split by recent activity, each channel keeping
+     * a floor of HOP_MIN_DWELL_PERCENT so quiet channels are still sampled.
+     */
+    class iohcHopPolicy {
+    public:
+        void begin(uint8_t channels, uint32_t baseDwell);
+        void setAdaptive(bool enable);
+        bool isAdaptive() const { return adaptive; }
+
+        void onPreamble(uint8_t channel);
+        void onFrame(uint8_t channel);
+        void onCycleEnd();
+
+        uint32_t dwellUs(uint8_t channel) const;
+        void dump() const;
+
+    private:
+        bool adaptive = false;      // Opt in with hopMode adaptive until measured on air
+        uint8_t numChannels = 1;
+        uint32_t baseDwellUs = 0;
+        uint32_t activity[HOP_MAX_CHANNELS]{};
+        uint32_t frames[HOP_MAX_CHANNELS]{};
+        uint32_t preambles[HOP_MAX_CHANNELS]{};
+    };
+}
+#endif
@@ -0,0 +1,45 @@
+/*
+   Copyright (c) 2024. CRIDP https://github.com/cridp
+
+   Licensed under the Apache License, Version 2.0 (the "License");
+   you may not use this file except in compliance with the License.
+   You may obtain a copy of the License at
+
+           http://www.apache.org/licenses/LICENSE-2.0
+
+   Unless required by applicable law or agreed to in writing, software
+   distributed under the License is distributed on an "AS IS" BASIS,
+   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+   See the License for the specific language governing permissions and
+   limitations under the License.
+ */
+
+#ifndef IOHC_LATENCY_H
+#define IOHC_LATENCY_H
+
+#include <cstdint>
+
+#define LATENCY_BUCKETS     24      // Power of two buckets in uS, the last one holds everything above ~4s
+
+namespace IOHC {
+    /**
+     * Fixed-size latency histogram with power of two buckets. Percentiles are reported as the
+     * upper bound of the bucket holding them, capped by the largest sample seen.
+     */
+    class iohcLatencyHistogram {
+    public:
+        void record(uint32_t us);
+        void reset();
+
+        uint32_t count() const { return samples; }
+        uint32_t max() const { return maxUs; }
+        uint32_t percentile(uint8_t pct) const;
+        void print(const char *name) const;
+
+    private:
+        uint32_t buckets[LATENCY_BUCKETS]{};
+        uint32_t samples = 0;
+        uint32_t maxUs = 0;
+    };
+}
+#endif
@@ -0,0 +1,64 @@
+/*
+   Copyright (c) 2024. CRIDP https://github.com/cridp
+
+   Licensed under the Apache License, Version 2.0 (the "License");
+   you may not use this file except in compliance with the License.
+   You may obtain a copy of the License at
+
+           http://www.apache.org/licenses/LICENSE-2.0
+
+   Unless required by applicable law or agreed to in writing, software
+   distributed under the License is distributed on an "AS IS" BASIS,
+   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+   See the License for the specific language governing permissions and
+   limitations under the License.
+ */
+
+#ifndef IOHC_LINK_STATS_H
+#define IOHC_LINK_STATS_H
+
+#include "freertos/FreeRTOS.h"
+
+#include <ArduinoJson.h>
+#include <cstdint>
+
+#include <iohcPacket.h>
+
+#define LINK_STATS_DEVICES      32      // Devices tracked, the least recently heard one is evicted
+#define LINK_STATS_CHANNELS     4       // CHANNEL1, CHANNEL2, CHANNEL3, anything else
+#define LINK_STATS_EWMA_SHIFT   3       // RSSI average weight of a new sample: 1/8
+
+namespace IOHC {
+    /**
+     * Bounded per-device link quality table fed by received frames: smoothed RSSI, last seen time,
+     * frames per channel and CRC/length errors. Updated by the dispatch task, read by web and MQTT.
+     * Frames failing their CRC are counted only, against a device already in the table.
+     */
+    class iohcLinkStats {
+    public:
+        struct entry {
+            bool used;
+            address node;
+            int16_t rssiEwmaX16;        // dBm x 16
+            int16_t lastRssi;           // dBm
+            int32_t lastAfc;            // Hz
+            uint32_t lastSeenS;         // seconds since boot
+            uint32_t frames[LINK_STATS_CHANNELS];
+            uint16_t crcErrors;
+            uint16_t lengthErrors;
+        };
+
+        void record(const iohcPacket *packet);
+        size_t snapshot(entry *out, size_t max);
+        void toJson(JsonArray &root);
+        void dump();
+
+    private:
+        static uint8_t channelIndex(uint32_t frequency);
+
+        portMUX_TYPE mux = portMUX_INITIALIZER_UNLOCKED;
+        entry entries[LINK_STATS_DEVICES]{};
+        uint32_t unknownCrcErrors = 0;  // Bad CRC frames whose source is not in the table
+    };
+}
+#endif
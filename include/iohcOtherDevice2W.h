@@ -23,6 +23,7 @@
 #include <tokens.h>
 
 #define OTHER_2W_FILE  "/Other2W.json"
+#define OTHER_2W_SCAN_CHUNK  16    // Scan steps queued at once, the next chunk is queued when this one is sent
 
 /*
     Singleton class with a full implementation of a COZYTOUCH/KIZBOX/CONEXOON controller
@@ -67,12 +68,21 @@ namespace IOHC {
         std::map<uint8_t, int> mapValid;
 //        void scanDump() override {}
 
-        static void forgePacket(iohcPacket *packet, const std::vector<uint8_t> &vector, size_t typn);
+        static bool forgePacket(iohcPacket *packet, const std::vector<uint8_t> &vector, size_t typn);
 
     private:
         iohcOtherDevice2W();
         static iohcOtherDevice2W *_iohcOtherDevice2W;
 
+        enum class ScanKind : uint8_t { None, Discovery, Custom, Check };
+        ScanKind scanKind = ScanKind::None;
+        int scanStep = 0;
+        std::vector<uint8_t> scanCmds;  // Commands of a check scan, picked when it starts
+        uint32_t scanId = 0;        // Bumped by each new scan, so the chunks of a replaced one stop
+        void startScan(ScanKind kind);
+        void sendScanChunk();
+        bool forgeScanStep(iohcPacket *packet, int step);
+
     protected:
         //            unsigned long relStamp;
         //            uint8_t source_originator[3] = {0};
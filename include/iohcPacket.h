@@ -29,7 +29,11 @@
 #define RESET_AFTER_LAST_MSG_US         15000
 #define MAX_FRAME_LEN                   32
 #define IOHC_INBOUND_MAX_PACKETS        255     // Maximum Inbound packets buffer
-#define IOHC_OUTBOUND_MAX_PACKETS       20      // Maximum Outbound packets
+#define IOHC_OUTBOUND_MAX_PACKETS       64      // TX packet pool size, see iohcPacketPool
+#define IOHC_POOL_REPLY_RESERVE         8       // Pool slots only protocol replies may take
+#define RX_ERROR_CRC                    0x01    // PayloadReady without CrcOk (CRCAUTOCLEAR_OFF), the frame is dropped after link stats
+#define RX_ERROR_LENGTH                 0x02    // Bytes drained differ from CtrlByte1.MsgLen + 1
+#define IOHC_RX_RING_SLOTS              16      // Preallocated RX slots between radio task and consumers (power of two)
 
 namespace IOHC {
     typedef uint8_t address[3];
@@ -220,21 +224,30 @@ namespace IOHC {
 
         Payload payload{};
         uint8_t buffer_length = 0;
-        uint32_t frequency = CHANNEL2; // Both 1W & 2W
+        uint32_t frequency = CHANNEL2; // Both 1W & 2W, 0 sends on the current scan frequency
         unsigned long repeatTime = 0L;
         uint8_t repeat = 0;
         bool lock = false;
-        unsigned long delayed = 0;
+        unsigned long delayed = 0; // ms between the end of the previous packet (queuing for the first) and this one
+        unsigned long stamp = 0L; // esp_timer time of the radio interrupt (PayloadReady / PacketSent)
+        unsigned long queuedStamp = 0L; // published in the RX ring by the radio task
+        unsigned long dispatchedStamp = 0L; // picked up by the dispatch task
+        unsigned long publishedStamp = 0L; // handed to MQTT
 
         double afc{}; // AFC freq correction applied
         uint8_t snr{}; // in dB
         float rssi{}; // -RSSI*2 of last packet received
         uint8_t lna{}; // LNA attenuation in dB
+        uint8_t rxErrors = 0; // RX_ERROR_* flags
 
         void decode(bool verbosity = false);
-        std::string decodeToString(bool verbosity = false);
+        size_t format(char *out, size_t size, bool verbosity = false) const;
+        size_t summarize(char *out, size_t size) const;
+        static void benchFormat(uint16_t rounds);
 
     protected:
+        char direction() const;
+        char summaryDirection() const;
         uint8_t source_originator[3] = {0};
     };
 }
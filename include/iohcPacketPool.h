@@ -0,0 +1,65 @@
+/*
+   Copyright (c) 2024. CRIDP https://github.com/cridp
+
+   Licensed under the Apache License, Version 2.0 (the "License");
+   you may not use this file except in compliance with the License.
+   You may obtain a copy of the License at
+
+           http://www.apache.org/licenses/LICENSE-2.0
+
+   Unless required by applicable law or agreed to in writing, software
+   distributed under the License is distributed on an "AS IS" BASIS,
+   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+   See the License for the specific language governing permissions and
+   limitations under the License.
+ */
+
+#ifndef IOHC_PACKET_POOL_H
+#define IOHC_PACKET_POOL_H
+
+#include "freertos/FreeRTOS.h"
+
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+
+#include <iohcPacket.h>
+
+namespace IOHC {
+    /**
+     * Static pool of IOHC_OUTBOUND_MAX_PACKETS packets for the TX path. Packets are handed out as
+     * RAII handles that return them to the pool when dropped; the radio takes ownership when a batch is
+     * queued and gives them back once sent. An empty handle means the pool is exhausted: the caller
+     * sends less (or nothing) and the refusal is counted. The last IOHC_POOL_REPLY_RESERVE slots are
+     * kept for protocol replies, so a long scan or batch can never starve an answer owed to a device.
+     */
+    class iohcPacketPool {
+    public:
+        struct Releaser {
+            void operator()(iohcPacket *packet) const { release(packet); }
+        };
+        using Handle = std::unique_ptr<iohcPacket, Releaser>;
+
+        static Handle acquire(bool reply = false);
+        static void release(iohcPacket *packet);
+
+        static size_t available();
+        static constexpr size_t capacity() { return IOHC_OUTBOUND_MAX_PACKETS; }
+        static void dump();
+
+    private:
+        static iohcPacket slots[IOHC_OUTBOUND_MAX_PACKETS];
+        static bool inUse[IOHC_OUTBOUND_MAX_PACKETS];
+        static uint8_t freeSlots[IOHC_OUTBOUND_MAX_PACKETS];   // Released slot indexes, used as a stack
+        static size_t freeCount;
+        static size_t neverUsed;                                // Slots at the end never handed out yet
+        static size_t lowWater;
+        static uint32_t exhausted;
+        static uint32_t reserveRefused;                         // Non-reply acquires refused to keep the reserve
+        static uint32_t invalidReleases;
+        static portMUX_TYPE mux;
+    };
+
+    using iohcPacketHandle = iohcPacketPool::Handle;
+}
+#endif
@@ -0,0 +1,81 @@
+/*
+   Copyright (c) 2024. CRIDP https://github.com/cridp
+
+   Licensed under the Apache License, Version 2.0 (the "License");
+   you may not use this file except in compliance with the License.
+   You may obtain a copy of the License at
+
+           http://www.apache.org/licenses/LICENSE-2.0
+
+   Unless required by applicable law or agreed to in writing, software
+   distributed under the License is distributed on an "AS IS" BASIS,
+   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+   See the License for the specific language governing permissions and
+   limitations under the License.
+ */
+
+#ifndef IOHC_PACKET_RING_H
+#define IOHC_PACKET_RING_H
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+
+#include <iohcPacket.h>
+
+namespace IOHC {
+    /**
+     * Fixed pool of iohcPacket slots shared by one producer (the radio task) and one consumer.
+     * The producer claims the slot at head, fills it and publishes it; the consumer peeks the
+     * slot at tail and releases it once done. No heap allocation happens after construction.
+     */
+    template <size_t N>
+    class iohcPacketRing {
+        static_assert(N >= 2 && (N & (N - 1)) == 0, "iohcPacketRing size must be a power of two");
+
+    public:
+        /** Producer: reset and return the next free slot, nullptr (and counted drop) if full */
+        iohcPacket *claim() {
+            const uint32_t h = head.load(std::memory_order_relaxed);
+            if (h - tail.load(std::memory_order_acquire) >= N) {
+                dropped.fetch_add(1, std::memory_order_relaxed);
+                return nullptr;
+            }
+            iohcPacket *slot = &slots[h & (N - 1)];
+            *slot = iohcPacket{};
+            return slot;
+        }
+
+        /** Producer: make the slot returned by claim() visible to the consumer */
+        void publish() {
+            head.store(head.load(std::memory_order_relaxed) + 1, std::memory_order_release);
+        }
+
+        /** Consumer: oldest published slot, nullptr if empty */
+        iohcPacket *peek() {
+            const uint32_t t = tail.load(std::memory_order_relaxed);
+            if (t == head.load(std::memory_order_acquire)) return nullptr;
+            return &slots[t & (N - 1)];
+        }
+
+        /** Consumer: give the slot returned by peek() back to the producer */
+        void release() {
+            tail.store(tail.load(std::memory_order_relaxed) + 1, std::memory_order_release);
+        }
+
+        size_t depth() const {
+            return head.load(std::memory_order_acquire) - tail.load(std::memory_order_acquire);
+        }
+
+        static constexpr size_t capacity() { return N; }
+
+        uint32_t drops() const { return dropped.load(std::memory_order_relaxed); }
+
+    private:
+        iohcPacket slots[N]{};
+        std::atomic<uint32_t> head{0};
+        std::atomic<uint32_t> tail{0};
+        std::atomic<uint32_t> dropped{0};
+    };
+}
+#endif
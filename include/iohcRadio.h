@@ -19,14 +19,23 @@
 
 #include "freertos/FreeRTOS.h"
 #include "freertos/task.h"
+#include "freertos/semphr.h"
 
 #include <Delegate.h>
 #include <cstdint>
-#include <queue>
+#include <deque>
 
 #include <board-config.h>
 #include <iohcCryptoHelpers.h>
 #include <iohcPacket.h>
+#include <iohcPacketRing.h>
+#include <iohcPacketPool.h>
+#include <iohcHopPolicy.h>
+#include <iohcDedupCache.h>
+#include <iohcLatency.h>
+#include <iohcLinkStats.h>
+#include <iohcCarrierSense.h>
+#include <iohcDutyCycle.h>
 
 #if defined(RADIO_SX127X)
         #include <SX1276Helpers.h>
@@ -40,8 +49,13 @@
 
 #define SM_GRANULARITY_US               130ULL  // Ticker function frequency in uS (100 minimum) 4 x 26µs = 104
 #define SM_GRANULARITY_MS               1       // Ticker function frequency in uS
-#define SM_PREAMBLE_RECOVERY_TIMEOUT_US 1378 // 12500   // SM_GRANULARITY_US * PREAMBLE_LSB //12500   // Maximum duration in uS of Preamble before reset of receiver
+#define SM_PREAMBLE_RECOVERY_TIMEOUT_US 1378 // 12500   // uS after a preamble detect before checking it still holds, else reset of receiver
+#define SM_PREAMBLE_MAX_US              520000  // Maximum duration in uS of Preamble (long wake up preamble + frame) before reset of receiver
 #define DEFAULT_SCAN_INTERVAL_US        13520   // Default uS between frequency changes
+#define SM_LOCK_TIMEOUT_US              500000  // Maximum uS a 2W exchange keeps the receiver on its channel
+#define IOHC_BITRATE                    38400   // FSK bitrate in bit/s
+#define TX_LATENCY_CMDS                 16      // Command types with their own TX latency histograms
+#define TX_IRQ_MARGIN_US                2000    // PacketSent expected within airtime + margin, else IRQFLAGS2 is polled
 
 /*
     Singleton class to implement an IOHC Radio abstraction layer for controllers.
@@ -51,6 +65,54 @@
 namespace IOHC {
     using IohcPacketDelegate = Delegate<bool(iohcPacket *iohc)>;
 
+    /**
+     * TX scheduling classes, highest first. A waiting batch of a higher class preempts a lower one
+     * between two packets; the preempted batch resumes where it stopped.
+     */
+    enum class TxPriority : uint8_t {
+        Reply,          ///< Protocol answers (challenge response, ack) the peer is waiting for
+        Interactive,    ///< User commands from console, MQTT or web
+        Background,     ///< Scans and discovery loops
+        Count
+    };
+
+    /**
+     * Kinds of commands where only the latest queued one matters. A queued batch not started yet is
+     * replaced by a newer one with the same kind and device.
+     */
+    enum class TxCoalesce : uint8_t {
+        None,
+        Remote1W,       ///< Any 0x00 command of a 1W remote (open, close, position...)
+        SetTemp2W       ///< Cozy setTemp of a 2W target
+    };
+
+    enum class TxStatus : uint8_t {
+        Sent,           ///< Every packet and repeat went on air
+        Superseded      ///< Replaced in the queue by a newer command for the same device, never sent
+    };
+
+    /**
+     * Outcome of a send request, handed to its completion handler. Times are esp_timer uS.
+     */
+    struct TxReport {
+        uint32_t id;
+        TxStatus status;
+        uint8_t cmd;            // Command of the first packet
+        int64_t queuedUs;
+        int64_t startUs;        // Batch taken from the queue, 0 when never started
+        int64_t firstAirUs;     // 0 when nothing went on air
+        int64_t doneUs;         // Last repeat of the last packet done, or time superseded
+    };
+    using TxDoneDelegate = Delegate<void(const TxReport &report)>;
+
+    /**
+     * How repeats and the next packets of a batch are paced.
+     */
+    enum class TxRepeatMode : uint8_t {
+        Ticker,         ///< Periodic timer every repeatTime, polling for TXDONE
+        Irq             ///< DIO0 PacketSent arms a one-shot timer for the exact remaining gap
+    };
+
     class iohcRadio  {
         public:
             static iohcRadio *getInstance();
@@ -65,25 +127,108 @@ namespace IOHC {
                 ERROR        ///< Error or unknown state
             };
             void start(uint8_t num_freqs, uint32_t *scan_freqs, uint32_t scanTimeUs, IohcPacketDelegate rxCallback, IohcPacketDelegate txCallback);
-            void send(iohcPacket *packet);
-            void send(std::vector<iohcPacket*>&iohcTx);
+            uint32_t send(iohcPacketHandle packet, TxPriority priority = TxPriority::Interactive,
+                          uint32_t coalesceKey = 0, TxDoneDelegate onDone = nullptr);
+            uint32_t send(std::vector<iohcPacketHandle> &iohcTx, TxPriority priority = TxPriority::Interactive,
+                          uint32_t coalesceKey = 0, TxDoneDelegate onDone = nullptr);
+            static constexpr uint32_t coalesceKey(TxCoalesce kind, const uint8_t *node) {
+                return static_cast<uint32_t>(kind) << 24 | node[0] << 16 | node[1] << 8 | node[2];
+            }
             static void setRadioState(RadioState newState);
             static const char* radioStateToString(RadioState state);
             volatile static RadioState radioState;
             static void tickerCounter(iohcRadio *radio);
             static volatile bool txComplete;
+            static volatile bool frequencyLocked;
+            volatile static unsigned long irqStamp;
+            void dispatchReceived();
+            void dumpStats();
+            void setFifoBurstRead(bool enable);
+            bool benchSpi(uint16_t rounds);
+            iohcHopPolicy hopPolicy{};
+            iohcDedupCache dedup{};
+            iohcLinkStats linkStats{};
+            iohcCarrierSense carrierSense{};
+            iohcDutyCycle dutyCycle{};
+            struct {
+                iohcLatencyHistogram isrToQueued;
+                iohcLatencyHistogram queuedToDispatched;
+                iohcLatencyHistogram dispatchedToPublished;
+                iohcLatencyHistogram isrToPublished;
+            } rxLatency{};
+            void dumpLatency();
+            void resetTxLatency();
+            void checkLockTimeout();
+            void setTxRepeatMode(TxRepeatMode mode);
+            TxRepeatMode getTxRepeatMode() const { return txRepeatMode; }
+            void onPacketSent();
+
+            /**
+             * RX state machine, driven by the DIO interrupts and by one one-shot timer holding either the
+             * hop deadline of the current channel or the preamble recovery timeout.
+             */
+            enum class RxEvent : uint8_t {
+                Preamble,       ///< Preamble detected
+                Payload,        ///< DIO0: PayloadReady, or PacketSent while in TX
+                Deadline,       ///< RX timer expired
+                Count
+            };
+            enum class RxTimer : uint8_t {
+                None,           ///< Leave the timer running
+                Dwell,          ///< Hop deadline of the current channel
+                PreambleRecovery
+            };
+            struct RxInputs {
+                bool locked;            // A 2W exchange holds the channel
+                bool preambleActive;    // Preamble detect still high and younger than SM_PREAMBLE_MAX_US
+                bool txBusy;            // A TX batch is in progress and holds its carrier until done
+            };
+            static constexpr uint8_t RX_RECEIVE = 0x01;         // Read the frame from the FIFO
+            static constexpr uint8_t RX_LISTEN = 0x02;          // Back to RX after PacketSent
+            static constexpr uint8_t RX_CLEAR_FLAGS = 0x04;
+            static constexpr uint8_t RX_HOP = 0x08;
+            static constexpr uint8_t RX_COUNT_PREAMBLE = 0x10;
+            struct RxStep {
+                RadioState next;
+                uint8_t actions;        // RX_* bits
+                RxTimer arm;
+            };
+            static constexpr RxStep rxTransition(RadioState state, RxEvent event, RxInputs in);
+            void rxEvent(RxEvent event);
             //static void setPreambleLength(uint16_t preambleLen);
 
         private:
             iohcRadio();
             bool receive(bool stats);
             bool sent(iohcPacket *packet);
-            void queueSend(std::vector<iohcPacket*> &iohcTx);
+            void trackExchange(const iohcPacket *packet);
+            void lockChannel();
+            void releaseChannel(bool completed);
+            uint32_t queueSend(std::vector<iohcPacketHandle> &iohcTx, TxPriority priority, uint32_t coalesceKey,
+                               TxDoneDelegate &onDone);
+            void completeRequest(TxReport &report, TxDoneDelegate &onDone, TxStatus status);
             void startQueuedSend();
+            bool preemptCurrent();
+            void scheduleCurrent(int64_t readyUs, bool first);
+            void startCurrent();
+            void listenSample();
+            void transmit(iohcPacket *packet, uint16_t preambleMs);
+            Radio::Frf frfForTx(const iohcPacket *packet);
+            void tuneTx(const iohcPacket *packet);
+            void restoreScanCarrier();
+            void txTick();
+            void armTxTimer(int64_t us);
+            void stopTxTimer();
+            static void onTxDeadline(void *arg);
+            static void onTxTimer(void *arg);
+            static void onLbtTimer(void *arg);
+            static void onDutyRetry(void *arg);
+            void hop();
+            void armRxTimer(uint32_t us);
+            static void onRxTimer(void *arg);
 
             static iohcRadio *_iohcRadio;
             static uint8_t _flags[2];
-            volatile static unsigned long _g_payload_millis;
             
             volatile static bool send_lock;
 
@@ -94,20 +239,99 @@ namespace IOHC {
 
             uint8_t num_freqs = 0;
             uint32_t *scan_freqs{};
+            std::vector<Radio::Frf> scanFrf{};  // FRF registers of scan_freqs, computed once in start()
             uint32_t scanTimeUs{};
             uint8_t currentFreqIdx = 0;
+            esp_timer_handle_t rxTimer = nullptr;   // One-shot: hop deadline or preamble recovery timeout
+            int64_t rxDeadlineUs = 0;
+            int64_t preambleStartUs = 0;
+            struct {
+                uint32_t events[static_cast<uint8_t>(RxEvent::Count)];
+                uint32_t staleDeadlines;
+                uint32_t hops;
+                uint32_t preambleRecoveries;
+            } rxStats{};
+            iohcLatencyHistogram rxDeadlineLateness{};  // Deadline to RX event handled
 
         #if defined(ESP8266)
             Timers::TickerUs Sender;
+            Timers::TickerUs DutyRetry;
         #elif defined(ESP32)
             TimersUS::TickerUsESP32 Sender;
+            TimersUS::TickerUsESP32 DutyRetry;      // Restarts background traffic deferred by the duty cycle
         #endif
+            bool dutyRetryArmed = false;
             iohcPacket *iohc{};
+            iohcPacketRing<IOHC_RX_RING_SLOTS> rxRing{};
+            uint32_t rxPublished = 0;
+            uint32_t rxDispatched = 0;
+            size_t rxHighWater = 0;
+            bool fifoBurstRead = true;
+            uint64_t rxDrainCycles = 0;
+            uint32_t rxDrainCyclesMax = 0;
+            uint32_t rxDrainFrames = 0;
+            uint32_t rxDrainBytes = 0;
+
+            portMUX_TYPE lockMux = portMUX_INITIALIZER_UNLOCKED;
+            int64_t lockStartUs = 0;
+            int64_t lockDeadlineUs = 0;
+            uint32_t locksStarted = 0;
+            uint32_t locksCompleted = 0;
+            uint32_t locksTimedOut = 0;
+            uint64_t lockTotalUs = 0;
+            uint32_t lockMaxUs = 0;
             
             IohcPacketDelegate rxCB = nullptr;
             IohcPacketDelegate txCB = nullptr;
             std::vector<iohcPacket*> packets2send{};
-            std::queue<std::vector<iohcPacket*>> sendQueue{};
+
+            struct TxBatch {
+                std::vector<iohcPacket*> packets;
+                int64_t queuedUs;
+                bool resumed;                   // Put back after preemption, already accounted
+                uint32_t coalesceKey;           // 0 when the batch is never replaced
+                TxReport report;
+                TxDoneDelegate onDone;
+            };
+            static constexpr uint8_t TX_CLASSES = static_cast<uint8_t>(TxPriority::Count);
+            SemaphoreHandle_t txMutex = nullptr;    // Recursive: onTxTicker restarts the queue while holding it
+            std::deque<TxBatch> sendQueues[TX_CLASSES]{};
+            TxPriority txPriority = TxPriority::Background;
+            struct {
+                uint32_t batches;
+                uint32_t preempted;
+                uint32_t coalesced;
+                size_t highWater;
+                iohcLatencyHistogram wait;      // Queued to batch taken from the queue
+            } txClassStats[TX_CLASSES]{};
+            int64_t txDueUs = 0;                // Deadline of the current packet
+            bool txFirstPending = false;        // Current packet opens its batch
+            uint32_t txCarrier = 0;             // Frequency tuned for TX, 0 when the scan owns the carrier
+            uint32_t txDeferred = 0;
+            uint32_t txRetunes = 0;
+            uint8_t txBackoffs = 0;             // LBT back-offs of the current packet
+            bool txListening = false;           // LBT window open, lbtTimer takes the samples
+            bool txChannelClear = false;        // LBT verdict reached, next startCurrent transmits
+            esp_timer_handle_t lbtTimer = nullptr;  // One-shot: next LBT RSSI sample
+            iohcLatencyHistogram txLateness{};  // Deadline to on air, packets with `delayed` only
+            esp_timer_handle_t txTimer = nullptr;   // One-shot: repeat gap or PacketSent watchdog in Irq mode
+            TxRepeatMode txRepeatMode = TxRepeatMode::Ticker;
+            bool txIrqDriven = false;           // Mode of the batch on air, latched when it starts
+            int64_t txStartUs = 0;              // Start of the transmission on air
+            uint32_t txWaitTicks = 0;           // Timer fired before TXDONE
+            iohcLatencyHistogram txRepeatJitter{};  // Repeat start vs previous start + repeatTime
+            uint32_t txNextId = 1;
+            TxReport txReport{};                // Request of the batch on air
+            TxDoneDelegate txDone = nullptr;
+            struct {
+                bool used;
+                uint8_t cmd;
+                uint32_t superseded;
+                iohcLatencyHistogram toStart;   // Queued to batch taken from the queue
+                iohcLatencyHistogram startToAir;    // Batch start to first packet on air: `delayed` and LBT back-offs
+                iohcLatencyHistogram toDone;    // Queued to last repeat done
+            } txLatency[TX_LATENCY_CMDS]{};
+            uint32_t txLatencyUntracked = 0;    // Requests of commands beyond TX_LATENCY_CMDS
         protected:
             static void i_preamble();
             static void i_payload();
@@ -18,6 +18,7 @@
 #define IOHC_1W_DEVICE_H
 
 #include <iohcDevice.h>
+#include <iohcFrameBuilder.h>
 #include <vector>
 #include <string>
 #include <tokens.h>
@@ -75,7 +76,7 @@ namespace IOHC {
         bool save() override;
 //        void scanDump() override { }
 
-        static void forgePacket(iohcPacket* packet, uint16_t typn);
+        static iohcFrameBuilder forgePacket(iohcPacket* packet, uint16_t typn);
 
         const std::vector<remote>& getRemotes() const;
         bool addRemote(const std::string &name);
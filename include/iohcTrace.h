@@ -0,0 +1,82 @@
+/*
+   Copyright (c) 2024. CRIDP https://github.com/cridp
+
+   Licensed under the Apache License, Version 2.0 (the "License");
+   you may not use this file except in compliance with the License.
+   You may obtain a copy of the License at
+
+           http://www.apache.org/licenses/LICENSE-2.0
+
+   Unless required by applicable law or agreed to in writing, software
+   distributed under the License is distributed on an "AS IS" BASIS,
+   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+   See the License for the specific language governing permissions and
+   limitations under the License.
+ */
+
+
+#ifndef IOHC_TRACE_H
+#define IOHC_TRACE_H
+
+#include "esp_attr.h"
+
+#include <ArduinoJson.h>
+#include <atomic>
+#include <cstdint>
+
+#define TRACE_ENTRIES       256     // Power of two, oldest events are overwritten
+
+namespace IOHC {
+    enum class TraceEvent : uint8_t {
+        Irq,            ///< a: preamble pin, b: payload pin
+        State,          ///< a: new RadioState
+        Preamble,       ///< a: preamble length in bytes
+        TxQueued,       ///< a: class, b: queue depth
+        TxCoalesced,    ///< a: class, b: coalesce key
+        TxPrepare,      ///< a: packets in the batch
+        TxBackoff,      ///< a: back-off in ms, b: attempt
+        TxSent,         ///< a: packet number, b: repeats
+        TxRepeat,       ///< a: repeats left
+        TxNext,         ///< a: packet number, b: delayed ms
+        TxWaiting,      ///< a: RadioState while TXDONE is pending
+        TxDoneByReg,    ///< PacketSent seen in IRQFLAGS2, the interrupt was missed
+        TxPreempted,    ///< a: preempted class, b: preempting class
+        TxBatchDone,    ///< a: packets sent
+        Count
+    };
+
+    /**
+     * Binary trace of radio events for ISR and timer context, where printing to the UART would
+     * distort the timings being looked at. Writers claim a slot with one atomic increment and never
+     * block; `dump` and `toJson` decode the most recent TRACE_ENTRIES events.
+     */
+    class iohcTrace {
+    public:
+        static void IRAM_ATTR record(TraceEvent event, uint32_t a = 0, uint32_t b = 0);
+        static void clear();
+        static void dump(size_t last = TRACE_ENTRIES);
+        static void toJson(JsonArray &root, size_t last = TRACE_ENTRIES);
+
+    private:
+        struct entry {
+            std::atomic<uint32_t> seq;  // Index + 1 of the event, 0 while being written
+            uint32_t us;                // Low 32 bits of esp_timer
+            uint32_t a;
+            uint32_t b;
+            TraceEvent event;
+        };
+        struct copy {
+            uint32_t us;
+            uint32_t a;
+            uint32_t b;
+            TraceEvent event;
+        };
+
+        static uint32_t first(size_t last);
+        static bool read(uint32_t idx, copy &out);
+
+        static entry entries[TRACE_ENTRIES];
+        static std::atomic<uint32_t> head;
+    };
+}
+#endif
@@ -3,6 +3,9 @@
 #include <Arduino.h>
 #include <vector>
 
+#define LOG_LINE_LEN    160     // Longer messages are truncated
+
+void addLogMessage(const char *msg);
 void addLogMessage(const String &msg);
 std::vector<String> getLogMessages();
 
@@ -27,6 +27,8 @@ void publishTravelTimeDiscovery(const std::string &id, const std::string &name,
                                 const std::string &key, uint32_t travelTime);
 void handleMqttConnect();
 void publishHeartbeat();
+void publishLinkStats();
+void publishDutyCycle();
 void mqttFuncHandler(const char *cmd);
 void publishCoverState(const std::string &id, const char *state);
 void publishCoverPosition(const std::string &id, float position);
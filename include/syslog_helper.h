@@ -15,10 +15,12 @@ void initSyslog();
 void resetSyslog();
 
 // Legacy signature (no severity)
+void sendSyslog(const char *msg);
 void sendSyslog(const String &msg);
 
 // New signature with explicit severity (0..7)
 // 0 emerg, 1 alert, 2 crit, 3 err, 4 warn, 5 notice, 6 info, 7 debug
+void sendSyslog(const char *msg, int severity);
 void sendSyslog(const String &msg, int severity);
 
 #endif // SYSLOG_HELPER_H
@@ -18,6 +18,7 @@
 
 #include <SX1276Helpers.h>
 #include <board-config.h>
+#include <iohcTrace.h>
 
 #if defined(RADIO_SX127X)
 #include <map>
@@ -28,6 +29,7 @@
 #define CONFIG_DISABLE_HAL_LOCKS true
 #include <TickerUsESP32.h>
 #include <esp_task_wdt.h>
+#include "esp_timer.h"
 #include <SPI.h>
 // #include <SPIeX.h>
 #endif
@@ -46,10 +48,87 @@ namespace Radio {
         {250, {0x00, 0x01}} // 250KHz
     };
 
+    // Shadow copy of the configuration registers: writes of an unchanged value and reads of a known one
+    // skip the SPI transaction. It is only touched with the bus held (SPI.beginTransaction takes the bus
+    // lock), so the comparison, the copy and the chip stay in step across tasks
+    uint8_t shadow[0x80];
+    uint8_t shadowValid[0x80 / 8];
+    uint32_t spiTransactions = 0;
+    uint32_t spiSaved = 0;
+
+/**
+ * The function `shadowable` tells whether a register only changes when written, so its shadow copy can
+ * stand in for the chip. FIFO, mode, status, measurement and self-clearing trigger registers cannot.
+ */
+    static bool IRAM_ATTR shadowable(uint8_t regAddr) {
+        if (regAddr >= 0x80) return false;
+        switch (regAddr) {
+            case REG_FIFO:
+            case REG_OPMODE:
+            case REG_LNA:               // LnaGain follows the AGC when AgcAutoOn
+            case REG_RXCONFIG:          // RestartRx triggers
+            case REG_RSSIVALUE:
+            case REG_AFCFEI:
+            case REG_AFCMSB:
+            case REG_AFCLSB:
+            case REG_FEIMSB:
+            case REG_FEILSB:
+            case REG_OSC:               // RcCalStart
+            case REG_SEQCONFIG1:        // SequencerStart/Stop
+            case REG_IMAGECAL:
+            case REG_TEMP:
+            case REG_IRQFLAGS1:
+            case REG_IRQFLAGS2:
+                return false;
+            default:
+                return true;
+        }
+    }
+
+    static bool IRAM_ATTR shadowKnown(uint8_t regAddr) {
+        return shadowable(regAddr) && (shadowValid[regAddr >> 3] & (1 << (regAddr & 7)));
+    }
+
+    static void IRAM_ATTR shadowStore(uint8_t regAddr, const uint8_t *in, uint8_t len) {
+        if (regAddr == REG_FIFO) return; // FIFO bursts do not advance the address
+        for (uint8_t idx = 0; idx < len; ++idx) {
+            const uint8_t reg = regAddr + idx;
+            if (!shadowable(reg)) continue;
+            shadow[reg] = in[idx];
+            shadowValid[reg >> 3] |= 1 << (reg & 7);
+        }
+    }
+
+    void invalidateShadow() {
+        SPI.beginTransaction(Radio::SpiSettings);
+        memset(shadowValid, 0, sizeof(shadowValid));
+        SPI.endTransaction();
+    }
+
+/**
+ * The function `dumpShadowStats` prints the SPI transactions done and avoided by the shadow registers,
+ * in total and per second since the previous call.
+ */
+    void dumpShadowStats() {
+        static uint32_t lastTransactions = 0;
+        static uint32_t lastSaved = 0;
+        static int64_t lastUs = 0;
+        const int64_t nowUs = esp_timer_get_time();
+        const float seconds = (nowUs - lastUs) / 1000000.0f;
+        printf("SPI: %u transactions, %u saved by shadow registers (%.1f/s done, %.1f/s saved since last)\n",
+               static_cast<unsigned>(spiTransactions), static_cast<unsigned>(spiSaved),
+               seconds > 0 ? (spiTransactions - lastTransactions) / seconds : 0.0f,
+               seconds > 0 ? (spiSaved - lastSaved) / seconds : 0.0f);
+        lastTransactions = spiTransactions;
+        lastSaved = spiSaved;
+        lastUs = nowUs;
+    }
+
 /**
  * The function `SPI_beginTransaction` begins a SPI transaction and sets the RADIO_NSS pin to LOW.
  */
     void IRAM_ATTR SPI_beginTransaction() {
+        spiTransactions++;
         SPI.beginTransaction(Radio::SpiSettings);
         digitalWrite(RADIO_NSS, LOW);
     }
@@ -106,6 +185,7 @@ namespace Radio {
         // SPI.beginTransaction(Radio::SpiSettings);
         // SPI.endTransaction();
 
+        invalidateShadow();
         writeByte(REG_OPMODE, RF_OPMODE_STANDBY); // Put Radio in Standby mode
 
         pinMode(SCAN_LED, OUTPUT);
@@ -116,7 +196,7 @@ namespace Radio {
 void setPreambleLength(uint16_t preambleLen) {
     writeByte(REG_PREAMBLEMSB, (preambleLen >> 8) & 0xFF);
     writeByte(REG_PREAMBLELSB, preambleLen & 0xFF);
-    ets_printf("Radio: Preamble length set to %u symbols\n", preambleLen);
+    IOHC::iohcTrace::record(IOHC::TraceEvent::Preamble, preambleLen);
 }
 
 /**
@@ -138,11 +218,11 @@ void setPreambleLength(uint16_t preambleLen) {
 
         // Variable packet lenght, generates working CRC.
         // Packet mode, IoHomeOn, IoHomePowerFrame to be added (0x10) to avoid rx to newly detect the preamble during tx radio shutdown
-        // Must CRCAUTOCLEAR_ON or do full clean FIFO !
+        // CRCAUTOCLEAR_OFF: PayloadReady also fires on a bad CRC so the failure can be counted, receive() drains the FIFO
         writeByte(
             REG_PACKETCONFIG1,
             RF_PACKETCONFIG1_PACKETFORMAT_VARIABLE | RF_PACKETCONFIG1_DCFREE_OFF | RF_PACKETCONFIG1_CRC_ON |
-            RF_PACKETCONFIG1_CRCAUTOCLEAR_ON | RF_PACKETCONFIG1_CRCWHITENINGTYPE_CCITT |
+            RF_PACKETCONFIG1_CRCAUTOCLEAR_OFF | RF_PACKETCONFIG1_CRCWHITENINGTYPE_CCITT |
             RF_PACKETCONFIG1_ADDRSFILTERING_OFF);
         writeByte(
             REG_PACKETCONFIG2,
@@ -150,9 +230,7 @@ void setPreambleLength(uint16_t preambleLen) {
         // Is IoHomePowerFrame useful ?
 
         // Preamble shall be set to AA for packets to be received by appliances. Sync word shall be set with different values if Rx or Tx
-        writeByte(
-            REG_SYNCCONFIG,
-            RF_SYNCCONFIG_AUTORESTARTRXMODE_WAITPLL_OFF | RF_SYNCCONFIG_PREAMBLEPOLARITY_AA | RF_SYNCCONFIG_SYNC_ON);
+        writeByte(REG_SYNCCONFIG, SYNCCONFIG_BASE);
         //0x51); // 0x91); // TODOVERIFY 0x92
         //RF_SYNCCONFIG_AUTORESTARTRXMODE_WAITPLL_ON | RF_SYNCCONFIG_PREAMBLEPOLARITY_AA | RF_SYNCCONFIG_SYNC_ON);
 
@@ -286,22 +364,20 @@ void setPreambleLength(uint16_t preambleLen) {
     //     SetChannel( initialFreq );
     // }
     void IRAM_ATTR setStandby() {
-        writeByte(REG_OPMODE, (readByte(REG_OPMODE) & RF_OPMODE_MASK) | RF_OPMODE_STANDBY);
+        runScript(SCRIPT_STANDBY);
     }
 
     void IRAM_ATTR setTx() {
         // Uncommon and incompatible settings
         // Enabling Sync word - Size must be set to SYNCSIZE_2 (0x01 in header file)
-        writeByte(REG_SYNCCONFIG, (readByte(REG_SYNCCONFIG) & RF_SYNCCONFIG_SYNCSIZE_MASK) | RF_SYNCCONFIG_SYNCSIZE_2);
-        writeByte(REG_OPMODE, (readByte(REG_OPMODE) & RF_OPMODE_MASK) | RF_OPMODE_TRANSMITTER);
+        runScript(SCRIPT_TX);
 
         TxReady;
     }
 
     void IRAM_ATTR setRx() {
         // Uncommon and incompatible settings
-        writeByte(REG_SYNCCONFIG, (readByte(REG_SYNCCONFIG) & RF_SYNCCONFIG_SYNCSIZE_MASK) | RF_SYNCCONFIG_SYNCSIZE_3);
-        writeByte(REG_OPMODE, (readByte(REG_OPMODE) & RF_OPMODE_MASK) | RF_OPMODE_RECEIVER);
+        runScript(SCRIPT_RX);
 
         RxReady;
         /*
@@ -359,20 +435,148 @@ void setPreambleLength(uint16_t preambleLen) {
         return (readByte(REG_IRQFLAGS2) & RF_IRQFLAGS2_FIFOEMPTY) == 0; //?false:true;
     }
 
-    uint8_t IRAM_ATTR readByte(uint8_t regAddr) {
-        uint8_t getByte;
-        readBytes(regAddr, &getByte, 1);
+/**
+ * The function `scriptWrite` writes consecutive registers in its own chip select frame, inside a bus
+ * transaction already held by the caller.
+ */
+    static void IRAM_ATTR scriptWrite(uint8_t regAddr, const uint8_t *in, uint8_t len) {
+        digitalWrite(RADIO_NSS, LOW);
+        SPI.write(regAddr | SPI_Write);
+        for (uint8_t idx = 0; idx < len; ++idx) SPI.write(in[idx]);
+        digitalWrite(RADIO_NSS, HIGH);
+        shadowStore(regAddr, in, len);
+    }
 
-        return (getByte);
+    static bool IRAM_ATTR shadowMatches(uint8_t regAddr, const uint8_t *in, uint8_t len) {
+        uint8_t idx = 0;
+        while (idx < len && shadowKnown(regAddr + idx) && shadow[regAddr + idx] == in[idx]) ++idx;
+        return idx == len;
     }
 
-    void IRAM_ATTR readBytes(uint8_t regAddr, uint8_t *out, uint8_t len) {
-        SPI_beginTransaction();
+/**
+ * The function `runScript` writes a list of registers taking the SPI bus once, toggling the chip select
+ * between registers. Entries the shadow registers already hold are skipped.
+ */
+    void IRAM_ATTR runScript(const RegWrite *script, uint8_t len) {
+        spiTransactions++;
+        SPI.beginTransaction(Radio::SpiSettings);
+        for (uint8_t idx = 0; idx < len; ++idx) {
+            if (shadowMatches(script[idx].addr, &script[idx].value, 1)) {
+                spiSaved++;
+                continue;
+            }
+            scriptWrite(script[idx].addr, &script[idx].value, 1);
+        }
+        SPI.endTransaction();
+    }
+
+/**
+ * The function `startTx` runs the whole TX start in one bus transaction: standby, carrier, preamble
+ * length, flags, FIFO and transmitter mode, then waits for TxReady like `setTx`.
+ */
+    void IRAM_ATTR startTx(const Frf &frf, uint16_t preambleLen, const uint8_t *frame, uint8_t len) {
+        const uint8_t preamble[2] = {static_cast<uint8_t>(preambleLen >> 8), static_cast<uint8_t>(preambleLen & 0xFF)};
+        const uint8_t noFlags[2] = {0, 0}; // Same as clearFlags()
+
+        spiTransactions++;
+        SPI.beginTransaction(Radio::SpiSettings);
+        scriptWrite(SCRIPT_STANDBY[0].addr, &SCRIPT_STANDBY[0].value, 1);
+        if (shadowMatches(REG_FRFMSB, frf.bytes, 3)) spiSaved++;
+        else scriptWrite(REG_FRFMSB, frf.bytes, 3);
+        if (shadowMatches(REG_PREAMBLEMSB, preamble, 2)) spiSaved++;
+        else scriptWrite(REG_PREAMBLEMSB, preamble, 2);
+        scriptWrite(REG_IRQFLAGS1, noFlags, 2);
+        scriptWrite(REG_FIFO, frame, len);
+        for (const auto &step : SCRIPT_TX) {
+            if (shadowMatches(step.addr, &step.value, 1)) spiSaved++;
+            else scriptWrite(step.addr, &step.value, 1);
+        }
+        SPI.endTransaction();
+        IOHC::iohcTrace::record(IOHC::TraceEvent::Preamble, preambleLen);
+
+        TxReady;
+    }
+
+/**
+ * The function `rawModify` is a read-modify-write of one register that always reads and writes the
+ * chip, as the driver did before the shadow registers.
+ */
+    static void rawModify(uint8_t regAddr, uint8_t mask, uint8_t bits) {
+        uint8_t value;
+        readBytes(regAddr, &value, 1);
+        value = (value & mask) | bits;
+        spiTransactions++;
+        SPI.beginTransaction(Radio::SpiSettings);
+        scriptWrite(regAddr, &value, 1);
+        SPI.endTransaction();
+    }
+
+/**
+ * The function `benchSpi` times a standby/RX round trip done register by register with read-modify-write,
+ * as the driver used to, against the same transition run as register scripts. The baseline bypasses the
+ * shadow registers. The radio is left in RX.
+ */
+    void benchSpi(uint16_t rounds) {
+        const uint32_t before = spiTransactions;
+        int64_t start = esp_timer_get_time();
+        for (uint16_t i = 0; i < rounds; i++) {
+            rawModify(REG_OPMODE, RF_OPMODE_MASK, RF_OPMODE_STANDBY);
+            rawModify(REG_SYNCCONFIG, RF_SYNCCONFIG_SYNCSIZE_MASK, RF_SYNCCONFIG_SYNCSIZE_3);
+            rawModify(REG_OPMODE, RF_OPMODE_MASK, RF_OPMODE_RECEIVER);
+        }
+        const int64_t perRegister = esp_timer_get_time() - start;
+        const uint32_t perRegisterSpi = spiTransactions - before;
+
+        start = esp_timer_get_time();
+        for (uint16_t i = 0; i < rounds; i++) {
+            runScript(SCRIPT_STANDBY);
+            runScript(SCRIPT_RX);
+        }
+        const int64_t scripted = esp_timer_get_time() - start;
+        const uint32_t scriptedSpi = spiTransactions - before - perRegisterSpi;
+        setRx();
+
+        printf("SPI bench, %u standby/RX transitions:\n", rounds);
+        printf("  register by register: %.1f uS, %.1f transactions each\n", static_cast<float>(perRegister) / rounds,
+               static_cast<float>(perRegisterSpi) / rounds);
+        printf("  register scripts:     %.1f uS, %.1f transactions each\n", static_cast<float>(scripted) / rounds,
+               static_cast<float>(scriptedSpi) / rounds);
+    }
+
+/**
+ * The function `frameRead` reads consecutive registers in its own chip select frame, inside a bus
+ * transaction already held by the caller.
+ */
+    static void IRAM_ATTR frameRead(uint8_t regAddr, uint8_t *out, uint8_t len) {
+        digitalWrite(RADIO_NSS, LOW);
         SPI.transfer(regAddr); // Send Address
         for (uint8_t idx = 0; idx < len; ++idx) {
             out[idx] = SPI.transfer(regAddr); // Get data
         }
-        SPI_endTransaction();
+        digitalWrite(RADIO_NSS, HIGH);
+    }
+
+    uint8_t IRAM_ATTR readByte(uint8_t regAddr) {
+        uint8_t getByte;
+        SPI.beginTransaction(Radio::SpiSettings);
+        if (shadowKnown(regAddr)) {
+            spiSaved++;
+            getByte = shadow[regAddr];
+        } else {
+            spiTransactions++;
+            frameRead(regAddr, &getByte, 1);
+            shadowStore(regAddr, &getByte, 1);
+        }
+        SPI.endTransaction();
+
+        return (getByte);
+    }
+
+    void IRAM_ATTR readBytes(uint8_t regAddr, uint8_t *out, uint8_t len) {
+        spiTransactions++;
+        SPI.beginTransaction(Radio::SpiSettings);
+        frameRead(regAddr, out, len);
+        SPI.endTransaction();
     }
 
     bool IRAM_ATTR writeByte(uint8_t regAddr, uint8_t data, bool check) {
@@ -380,12 +584,16 @@ void setPreambleLength(uint16_t preambleLen) {
     }
 
     auto IRAM_ATTR writeBytes(uint8_t regAddr, uint8_t *in, uint8_t len, bool check) -> bool {
-        SPI_beginTransaction();
-        SPI.write(regAddr | SPI_Write); // Send Address with Write flag
-        for (uint8_t idx = 0; idx < len; ++idx) {
-            SPI.write(in[idx]); // Send data
+        // Compare, copy and write with the bus held, another task cannot slip a write in between
+        SPI.beginTransaction(Radio::SpiSettings);
+        if (!check && regAddr != REG_FIFO && shadowMatches(regAddr, in, len)) {
+            spiSaved++;
+            SPI.endTransaction();
+            return true;
         }
-        SPI_endTransaction();
+        spiTransactions++;
+        scriptWrite(regAddr, in, len);
+        SPI.endTransaction();
 
         if (check) {
             SPI_beginTransaction();
@@ -435,12 +643,7 @@ void setPreambleLength(uint16_t preambleLen) {
 
         switch (param) {
             case Carrier::Frequency:
-                /*uint32_t FRF = (newFreq * (uint32_t(1) << RADIOLIB_SX127X_DIV_EXPONENT)) / RADIOLIB_SX127X_CRYSTAL_FREQ;*/
-                tmpVal = static_cast<uint32_t>((static_cast<float_t>(value) / FXOSC) * (1 << 19));
-                out[0] = (tmpVal & 0x00ff0000) >> 16;
-                out[1] = (tmpVal & 0x0000ff00) >> 8;
-                out[2] = (tmpVal & 0x000000ff); // If Radio is active writing LSB triggers frequency change
-                writeBytes(REG_FRFMSB, out, 3);
+                setFrequency(frfFor(value));
                 break;
             case Carrier::Bandwidth:
                 bw = bwRegs(value);
@@ -484,6 +687,22 @@ void setPreambleLength(uint16_t preambleLen) {
         return true;
     }
 
+/**
+ * The function `frfFor` computes the FRF register values of a carrier frequency, so hopping between
+ * known channels can reuse them instead of redoing the float math.
+ */
+    Frf frfFor(uint32_t frequency) {
+        /*uint32_t FRF = (newFreq * (uint32_t(1) << RADIOLIB_SX127X_DIV_EXPONENT)) / RADIOLIB_SX127X_CRYSTAL_FREQ;*/
+        const auto tmpVal = static_cast<uint32_t>((static_cast<float_t>(frequency) / FXOSC) * (1 << 19));
+        return {{static_cast<uint8_t>((tmpVal & 0x00ff0000) >> 16), static_cast<uint8_t>((tmpVal & 0x0000ff00) >> 8),
+                 static_cast<uint8_t>(tmpVal & 0x000000ff)}};
+    }
+
+    void IRAM_ATTR setFrequency(const Frf &frf) {
+        uint8_t out[3] = {frf.bytes[0], frf.bytes[1], frf.bytes[2]};
+        writeBytes(REG_FRFMSB, out, 3); // If Radio is active writing LSB triggers frequency change
+    }
+
     regBandWidth bwRegs(uint8_t bandwidth) {
         for (auto &it: __bw)
             if (it.first == bandwidth)
@@ -19,6 +19,8 @@
 #include <iohcOtherDevice2W.h>
 #include <iohcRemoteMap.h>
 #include <iohcPacket.h>
+#include <iohcCryptoHelpers.h>
+#include <iohcTrace.h>
 #include <interact.h>
 #include <wifi_helper.h>
 #include <oled_display.h>
@@ -289,6 +291,113 @@ void createCommands() {
 //        Serial.printf("*%d packets in memory\t", nextPacket);
 //        Serial.printf("*%d devices discovered\n\n", sysTable->size());
     });
+    Cmd::addHandler((char *) "radioStats", (char *) "Show radio RX/TX pipeline counters", [](Tokens *cmd)-> void {
+        IOHC::iohcRadio::getInstance()->dumpStats();
+    });
+    Cmd::addHandler((char *) "rxBurst", (char *) "on off - Burst or byte-wise RX FIFO read", [](Tokens *cmd)-> void {
+        if (cmd->size() < 2) {
+            Serial.println("Usage: rxBurst <on|off>");
+            return;
+        }
+        IOHC::iohcRadio::getInstance()->setFifoBurstRead(cmd->at(1) == "on");
+    });
+    Cmd::addHandler((char *) "hopMode", (char *) "adaptive fixed - Dwell time policy of the channel scan", [](Tokens *cmd)-> void {
+        auto &policy = IOHC::iohcRadio::getInstance()->hopPolicy;
+        if (cmd->size() >= 2) policy.setAdaptive(cmd->at(1) == "adaptive");
+        policy.dump();
+    });
+    Cmd::addHandler((char *) "dedup", (char *) "ms - Window ignoring 1W repeats, 0 delivers all", [](Tokens *cmd)-> void {
+        auto &dedup = IOHC::iohcRadio::getInstance()->dedup;
+        if (cmd->size() >= 2) {
+            int windowMs = atoi(cmd->at(1).c_str());
+            if (windowMs < 0 || windowMs > 65535) {
+                Serial.println("Invalid window value");
+                return;
+            }
+            dedup.setWindowMs(static_cast<uint16_t>(windowMs));
+        }
+        dedup.dump();
+    });
+    Cmd::addHandler((char *) "latency", (char *) "RX stage and TX per command latency, reset to clear", [](Tokens *cmd)-> void {
+        auto *radio = IOHC::iohcRadio::getInstance();
+        if (cmd->size() >= 2 && cmd->at(1) == "reset") {
+            radio->rxLatency.isrToQueued.reset();
+            radio->rxLatency.queuedToDispatched.reset();
+            radio->rxLatency.dispatchedToPublished.reset();
+            radio->rxLatency.isrToPublished.reset();
+            radio->resetTxLatency();
+        }
+        radio->dumpLatency();
+    });
+    Cmd::addHandler((char *) "linkStats", (char *) "Per device RSSI, last seen, frames per channel", [](Tokens *cmd)-> void {
+        IOHC::iohcRadio::getInstance()->linkStats.dump();
+    });
+    Cmd::addHandler((char *) "lbt", (char *) "on off [dBm] [uS] - Listen before talk, threshold, window", [](Tokens *cmd)-> void {
+        auto &lbt = IOHC::iohcRadio::getInstance()->carrierSense;
+        if (cmd->size() >= 2) {
+            int thresholdDbm = cmd->size() >= 3 ? atoi(cmd->at(2).c_str()) : LBT_DEFAULT_THRESHOLD_DBM;
+            int windowUs = cmd->size() >= 4 ? atoi(cmd->at(3).c_str()) : LBT_DEFAULT_WINDOW_US;
+            if (thresholdDbm < -127 || thresholdDbm > 0 || windowUs < 0 || windowUs > LBT_MAX_WINDOW_US) {
+                Serial.printf("Usage: lbt on|off [-127..0 dBm] [0..%u uS]\n", LBT_MAX_WINDOW_US);
+                return;
+            }
+            lbt.configure(cmd->at(1) == "on", static_cast<int16_t>(thresholdDbm), static_cast<uint16_t>(windowUs));
+        }
+        lbt.dump();
+    });
+    Cmd::addHandler((char *) "txMode", (char *) "ticker irq - Pace repeats by timer or PacketSent interrupt", [](Tokens *cmd)-> void {
+        auto *radio = IOHC::iohcRadio::getInstance();
+        if (cmd->size() >= 2) {
+            if (cmd->at(1) == "irq") radio->setTxRepeatMode(IOHC::TxRepeatMode::Irq);
+            else if (cmd->at(1) == "ticker") radio->setTxRepeatMode(IOHC::TxRepeatMode::Ticker);
+            else {
+                Serial.println("Usage: txMode <ticker|irq>");
+                return;
+            }
+        }
+        Serial.printf("TX repeats paced by %s\n",
+                      radio->getTxRepeatMode() == IOHC::TxRepeatMode::Irq ? "PacketSent interrupt" : "ticker");
+    });
+    Cmd::addHandler((char *) "bench", (char *) "spi|fmt|crc|aes [n] - Time n radio mode transitions per SPI method, n frame log lines per formatter, n frame CRCs, or n AES blocks", [](Tokens *cmd)-> void {
+        if (cmd->size() < 2 || (cmd->at(1) != "spi" && cmd->at(1) != "fmt" && cmd->at(1) != "crc" && cmd->at(1) != "aes")) {
+            Serial.println("Usage: bench spi|fmt|crc|aes [1..10000]");
+            return;
+        }
+        int rounds = cmd->size() >= 3 ? atoi(cmd->at(2).c_str()) : 100;
+        if (rounds < 1 || rounds > 10000) {
+            Serial.println("Usage: bench spi|fmt|crc|aes [1..10000]");
+            return;
+        }
+        if (cmd->at(1) == "fmt") {
+            IOHC::iohcPacket::benchFormat(static_cast<uint16_t>(rounds));
+            return;
+        }
+        if (cmd->at(1) == "crc") {
+            iohcCrypto::benchCrc(static_cast<uint16_t>(rounds));
+            return;
+        }
+        if (cmd->at(1) == "aes") {
+            iohcCrypto::benchAes(static_cast<uint16_t>(rounds));
+            return;
+        }
+        if (!IOHC::iohcRadio::getInstance()->benchSpi(static_cast<uint16_t>(rounds)))
+            Serial.println("Radio is busy (sending, locked or receiving), try again");
+    });
+    Cmd::addHandler((char *) "trace", (char *) "[n|clear] - Decode the last n radio trace events", [](Tokens *cmd)-> void {
+        if (cmd->size() >= 2 && cmd->at(1) == "clear") {
+            IOHC::iohcTrace::clear();
+            return;
+        }
+        int last = cmd->size() >= 2 ? atoi(cmd->at(1).c_str()) : TRACE_ENTRIES;
+        if (last <= 0) {
+            Serial.println("Usage: trace [1..256|clear]");
+            return;
+        }
+        IOHC::iohcTrace::dump(static_cast<size_t>(last));
+    });
+    Cmd::addHandler((char *) "dutyCycle", (char *) "Airtime used and budget left per sub-band, last hour", [](Tokens *cmd)-> void {
+        IOHC::iohcRadio::getInstance()->dutyCycle.dump();
+    });
     /*    
     //    Cmd::addHandler((char *)"dump2", (char *)"Dump Transceiver registers 1Col", [](Tokens*cmd)->void {Radio::dump2(); Serial.printf("*%d packets in memory\t", nextPacket); Serial.printf("*%d devices discovered\n\n", sysTable->size());});
     Cmd::addHandler((char *) "list1W", (char *) "List received packets", [](Tokens *cmd)-> void {
@@ -0,0 +1,79 @@
+/*
+   Copyright (c) 2024. CRIDP https://github.com/cridp
+
+   Licensed under the Apache License, Version 2.0 (the "License");
+   you may not use this file except in compliance with the License.
+   You may obtain a copy of the License at
+
+           http://www.apache.org/licenses/LICENSE-2.0
+
+   Unless required by applicable law or agreed to in writing, software
+   distributed under the License is distributed on an "AS IS" BASIS,
+   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+   See the License for the specific language governing permissions and
+   limitations under the License.
+ */
+
+#include <cstdio>
+#include "esp_random.h"
+#include "esp_timer.h"
+
+#include <iohcCarrierSense.h>
+#include <SX1276Helpers.h>
+
+namespace IOHC {
+    void iohcCarrierSense::configure(bool enable, int16_t thresholdDbm, uint16_t windowUs) {
+        enabled = enable;
+        threshold = thresholdDbm;
+        window = windowUs > LBT_MAX_WINDOW_US ? LBT_MAX_WINDOW_US : windowUs;
+    }
+
+/**
+ * The `begin` function opens a listening window, right after the receiver was switched to RX.
+ */
+    void iohcCarrierSense::begin() {
+        checks++;
+        startUs = esp_timer_get_time();
+        peak = -128;
+    }
+
+/**
+ * The `sample` function reads REG_RSSIVALUE once the receiver settled, and ends the window as soon
+ * as the threshold is reached or the configured window is over.
+ *
+ * @return Busy if the transmission must back off, Clear if it may go, Listening otherwise.
+ */
+    iohcCarrierSense::Verdict iohcCarrierSense::sample() {
+        const int64_t elapsed = esp_timer_get_time() - startUs;
+        if (elapsed < LBT_SETTLE_US) return Verdict::Listening;
+        const int16_t dbm = -static_cast<int16_t>(Radio::readByte(REG_RSSIVALUE)) / 2;
+        if (dbm > peak) peak = dbm;
+        if (peak >= threshold) {
+            lastPeak = peak;
+            busy++;
+            return Verdict::Busy;
+        }
+        if (elapsed < LBT_SETTLE_US + window) return Verdict::Listening;
+        lastPeak = peak;
+        return Verdict::Clear;
+    }
+
+/**
+ * The `backoffMs` function draws a random back-off, the range doubling with each attempt so
+ * transmitters that backed off together spread out.
+ */
+    uint32_t iohcCarrierSense::backoffMs(uint8_t attempt) {
+        uint32_t range = LBT_BACKOFF_MIN_MS << attempt;
+        if (range > LBT_BACKOFF_MAX_MS) range = LBT_BACKOFF_MAX_MS;
+        backoffs++;
+        return LBT_BACKOFF_MIN_MS + esp_random() % range;
+    }
+
+    void iohcCarrierSense::dump() const {
+        printf("LBT: %s, threshold %ddBm, window %uus, last peak %ddBm\n", enabled ? "on" : "off",
+               threshold, window, lastPeak);
+        printf("LBT: %u checks, %u busy, %u back-offs, %u sent after %u attempts\n",
+               static_cast<unsigned>(checks), static_cast<unsigned>(busy), static_cast<unsigned>(backoffs),
+               static_cast<unsigned>(forced), LBT_MAX_BACKOFFS);
+    }
+}
@@ -17,6 +17,7 @@
 #include <iohcCozyDevice2W.h>
 #include <LittleFS.h>
 #include <iohcCryptoHelpers.h>
+#include <iohcFrameBuilder.h>
 #include <ArduinoJson.h>
 #include <numeric>
 
@@ -37,27 +38,23 @@ namespace IOHC {
     * @brief Forge a Cozy packet into iohcPacket. This is the function that is called when calling a command
     * @param packet * The IOHC packet to forge
     * @param toSend
+    * @return false when the data does not fit the frame, the packet must not be sent
     */
-    void iohcCozyDevice2W::forgePacket(iohcPacket *packet, const std::vector<unsigned char> &toSend) {
+    bool iohcCozyDevice2W::forgePacket(iohcPacket *packet, const std::vector<unsigned char> &toSend) {
         digitalWrite(RX_LED, digitalRead(RX_LED) ^ 1);
         IOHC::relStamp = esp_timer_get_time();
 
-        // Common Flags
-        // 8 if protocol version is 0 else 10
-        packet->payload.packet.header.CtrlByte1.asStruct.MsgLen = sizeof(_header) - 1;
-        packet->payload.packet.header.CtrlByte1.asStruct.Protocol = 0;
-        packet->payload.packet.header.CtrlByte1.asStruct.StartFrame = 1;
-        packet->payload.packet.header.CtrlByte1.asStruct.EndFrame = 0;
-        packet->payload.packet.header.CtrlByte2.asByte = 0;
-
-        packet->payload.packet.header.CtrlByte1.asByte += toSend.size();
-        memcpy(packet->payload.buffer + 9, toSend.data(), toSend.size());
-        packet->buffer_length = toSend.size() + 9;
+        // Common Flags, 2W start frame
+        if (iohcFrameBuilder(packet, false).bytes(toSend.data(), toSend.size()).truncated()) {
+            printf("ERROR: Cozy frame truncated (%u bytes), not sent\n", static_cast<unsigned>(toSend.size()));
+            return false;
+        }
 
         packet->frequency = CHANNEL2;
         packet->repeatTime = 25;
         packet->repeat = 0;
         packet->lock = false;
+        return true;
     }
 
     /**
@@ -84,8 +81,9 @@ namespace IOHC {
             case DeviceButton::associate: {
                 std::vector<uint8_t> toSend = {};
 
-                auto* packet = new iohcPacket;
-                forgePacket(packet, toSend);
+                auto packet = iohcPacketPool::acquire();
+                if (!packet) break;
+                if (!forgePacket(packet.get(), toSend)) break;
 
                 packet->payload.packet.header.cmd = iohcDevice::SEND_ASK_CHALLENGE_0x31;
                 memorizeSend.memorizedData = toSend;
@@ -98,14 +96,15 @@ namespace IOHC {
                 memcpy(packet->payload.packet.header.target, master_to, 3);
 
                 digitalWrite(RX_LED, digitalRead(RX_LED) ^ 1);
-                _radioInstance->send(packet);
+                _radioInstance->send(std::move(packet));
                 break;
             }
             case DeviceButton::powerOn: {
                 std::vector<uint8_t> toSend = {0x0C, 0x60, 0x01, 0x2C};
 
-                auto* packet = new iohcPacket;
-                forgePacket(packet, toSend);
+                auto packet = iohcPacketPool::acquire();
+                if (!packet) break;
+                if (!forgePacket(packet.get(), toSend)) break;
 
                 packet->payload.packet.header.cmd = iohcDevice::SEND_WRITE_PRIVATE_0x20;
                 memorizeSend.memorizedCmd = iohcDevice::SEND_WRITE_PRIVATE_0x20;
@@ -117,7 +116,7 @@ namespace IOHC {
                 memcpy(packet->payload.packet.header.target, master_to, 3);
 
                 digitalWrite(RX_LED, digitalRead(RX_LED) ^ 1);
-                _radioInstance->send(packet);
+                _radioInstance->send(std::move(packet));
 
                 break;
             }
@@ -131,8 +130,9 @@ namespace IOHC {
                 if (data->size() == 2) addr = 0;
                 else addr = std::stoi(data->at(2));
 
-                auto* packet = new iohcPacket;
-                forgePacket(packet, toSend);
+                auto packet = iohcPacketPool::acquire();
+                if (!packet) break;
+                if (!forgePacket(packet.get(), toSend)) break;
 
                 packet->payload.packet.header.cmd = iohcDevice::SEND_WRITE_PRIVATE_0x20;
                 memorizeSend.memorizedData = toSend;
@@ -146,7 +146,9 @@ namespace IOHC {
                 packet->delayed = 50;
 
                 digitalWrite(RX_LED, digitalRead(RX_LED) ^ 1);
-                _radioInstance->send(packet);
+                // Only the latest setpoint for this target is worth sending
+                _radioInstance->send(std::move(packet), TxPriority::Interactive,
+                                     iohcRadio::coalesceKey(TxCoalesce::SetTemp2W, addresses.at(addr).data()));
                 //                mqttClient.publish("iown/Frame", 0, false, message.c_str(), messageSize);
 
                 break;
@@ -167,11 +169,15 @@ namespace IOHC {
 
                 size_t dest = 0;
 
-                std::vector<iohcPacket *> packets2send;
+                std::vector<iohcPacketHandle> packets2send;
                 for (const auto &addr: addresses) {
-                    auto* packet = new iohcPacket;
-                    packets2send.push_back(packet);
-                    forgePacket(packet, toSend);
+                    packets2send.push_back(iohcPacketPool::acquire());
+                    auto *packet = packets2send.back().get();
+                    if (!packet) break;
+                    if (!forgePacket(packet, toSend)) {
+                        packets2send.pop_back();
+                        break;
+                    }
 
                     packet->payload.packet.header.cmd = iohcDevice::SEND_WRITE_PRIVATE_0x20;
                     memorizeSend.memorizedData = toSend;
@@ -184,7 +190,7 @@ namespace IOHC {
 
                     dest++;
                 }
-                packets2send[1]->delayed = 250;
+                if (packets2send.size() > 1 && packets2send[1]) packets2send[1]->delayed = 250;
                 digitalWrite(RX_LED, digitalRead(RX_LED) ^ 1);
 
                 _radioInstance->send(packets2send);
@@ -198,8 +204,9 @@ namespace IOHC {
                 if (strcasecmp(dat, "on") == 0) toSend[4] = 0x01;
                 if (strcasecmp(dat, "off") == 0) toSend[4] = 0x00;
 
-                auto* packet = new iohcPacket;
-                forgePacket(packet, toSend);
+                auto packet = iohcPacketPool::acquire();
+                if (!packet) break;
+                if (!forgePacket(packet.get(), toSend)) break;
 
                 packet->payload.packet.header.cmd = iohcDevice::SEND_WRITE_PRIVATE_0x20;
                 memorizeSend.memorizedData = toSend;
@@ -211,7 +218,7 @@ namespace IOHC {
                 memcpy(packet->payload.packet.header.target, master_to, 3);
 
                 digitalWrite(RX_LED, digitalRead(RX_LED) ^ 1);
-                _radioInstance->send(packet);
+                _radioInstance->send(std::move(packet));
                 break;
             }
             case DeviceButton::setWindow: {
@@ -225,8 +232,9 @@ namespace IOHC {
                 if (data->size() == 2) addr = 0;
                 else addr = std::stoi(data->at(2));
 
-                auto* packet = new iohcPacket;
-                forgePacket(packet, toSend);
+                auto packet = iohcPacketPool::acquire();
+                if (!packet) break;
+                if (!forgePacket(packet.get(), toSend)) break;
 
                 packet->payload.packet.header.cmd = iohcDevice::SEND_WRITE_PRIVATE_0x20;
                 memorizeSend.memorizedData = toSend;
@@ -240,7 +248,7 @@ namespace IOHC {
                 packet->delayed = 50;
 
                 digitalWrite(RX_LED, digitalRead(RX_LED) ^ 1);
-                _radioInstance->send(packet);
+                _radioInstance->send(std::move(packet));
                 break;
             }
             case DeviceButton::midnight: {
@@ -248,8 +256,9 @@ namespace IOHC {
                 std::vector<uint8_t> toSend = {0x0c, 0x60, 0x01, 0x30};
                 //, 0x2b, 0x05, 0x00, 0x0f, 0x04, 0x0c, 0xe7, 0x07};
 
-                auto *packet = new iohcPacket;
-                forgePacket(packet, toSend);
+                auto packet = iohcPacketPool::acquire();
+                if (!packet) break;
+                if (!forgePacket(packet.get(), toSend)) break;
 
                 packet->payload.packet.header.cmd = iohcDevice::SEND_WRITE_PRIVATE_0x20;
                 memorizeSend.memorizedData = toSend;
@@ -261,7 +270,7 @@ namespace IOHC {
                 memcpy(packet->payload.packet.header.target, master_to, 3);
 
                 digitalWrite(RX_LED, digitalRead(RX_LED) ^ 1);
-                _radioInstance->send(packet);
+                _radioInstance->send(std::move(packet));
 
                 break;
             }
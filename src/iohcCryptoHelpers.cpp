@@ -16,6 +16,9 @@
 
 #include <iohcCryptoHelpers.h>
 #include <crypto2Wutils.h> 
+#include <iohcFormatter.h>
+#include <cstring>
+#include <esp_timer.h>
 /*
     Helper function to convert a string containing hex numbers to a bytes sequence; one byte every two characters
 */
@@ -36,57 +39,199 @@ size_t i;
 */
 std::string bytesToHexString(const uint8_t *byteString, uint8_t len) {
     char rec[len*2+1];
-
-    for (uint8_t i=0; i<len; i++)
-        sprintf((rec+(i*2)), "%2.2x", byteString[i]);
+    rec[IOHC::hexEncode(rec, byteString, len)] = '\0';
 
     return std::string(rec);
 }
 
 namespace iohcCrypto {
-    std::string transfer_key = "34c3466ed88f4e8e16aa473949884373";
-
-
 #if defined(ESP8266)
     AES128 aes128;
-    CTR<AES128> ctraes128;
-#elif defined(ESP32)
-    mbedtls_aes_context aes;
 #endif
-    
-    uint16_t computeCrc(uint8_t data, uint16_t crc = 0) {
-        crc ^= data;
-        for (int i = 0; i < 8; ++i) {
-            unsigned int remainder = (crc & 1) ? CRC_POLYNOMIAL_CCITT : 0;
-            crc = (crc >> 1) ^ remainder;
+
+/**
+ * The `aes128Encrypt` function encrypts one 16 bytes block, `in` and `out` may be the same buffer. On ESP32 it
+ * runs on the AES peripheral through mbedtls, with a context of its own so the 1W and 2W callers
+ * can run from different tasks.
+ */
+    void aes128Encrypt(const uint8_t *key, const uint8_t *in, uint8_t *out) {
+        #if defined(ESP8266)
+            aes128.setKey(key, 16);
+            aes128.encryptBlock(out, in);
+        #elif defined(ESP32)
+            mbedtls_aes_context context;
+            mbedtls_aes_init(&context);
+            mbedtls_aes_setkey_enc(&context, key, 128);
+            mbedtls_aes_crypt_ecb(&context, MBEDTLS_AES_ENCRYPT, in, out);
+            mbedtls_aes_free(&context);
+        #endif
+    }
+
+    namespace {
+        struct AesVector {
+            uint8_t key[16];
+            uint8_t plain[16];
+            uint8_t cipher[16];
+        };
+
+        // FIPS-197 appendix C.1, then SP 800-38A F.1.1 ECB-AES128 block #1
+        constexpr AesVector AES_VECTORS[] = {
+            {{0x00, 0x01, 0x02, 0x03, 0x04, 0x05, 0x06, 0x07, 0x08, 0x09, 0x0a, 0x0b, 0x0c, 0x0d, 0x0e, 0x0f},
+             {0x00, 0x11, 0x22, 0x33, 0x44, 0x55, 0x66, 0x77, 0x88, 0x99, 0xaa, 0xbb, 0xcc, 0xdd, 0xee, 0xff},
+             {0x69, 0xc4, 0xe0, 0xd8, 0x6a, 0x7b, 0x04, 0x30, 0xd8, 0xcd, 0xb7, 0x80, 0x70, 0xb4, 0xc5, 0x5a}},
+            {{0x2b, 0x7e, 0x15, 0x16, 0x28, 0xae, 0xd2, 0xa6, 0xab, 0xf7, 0x15, 0x88, 0x09, 0xcf, 0x4f, 0x3c},
+             {0x6b, 0xc1, 0xbe, 0xe2, 0x2e, 0x40, 0x9f, 0x96, 0xe9, 0x3d, 0x7e, 0x11, 0x73, 0x93, 0x17, 0x2a},
+             {0x3a, 0xd7, 0x7b, 0xb4, 0x0d, 0x7a, 0x36, 0x60, 0xa8, 0x9e, 0xca, 0xf3, 0x24, 0x66, 0xef, 0x97}},
+        };
+    }
+
+/**
+ * The `aesSelfTest` function checks `aes128Encrypt` against the known answer vectors, and against the
+ * byte-wise AES of crypto2Wutils.h the 2W path used before.
+ *
+ * @return true when every vector matches.
+ */
+    bool aesSelfTest() {
+        bool ok = true;
+        for (const auto &vector : AES_VECTORS) {
+            uint8_t block[16];
+            aes128Encrypt(vector.key, vector.plain, block);
+            if (memcmp(block, vector.cipher, sizeof(block)) != 0) ok = false;
+
+            AES_ctx reference;
+            memcpy(block, vector.plain, sizeof(block));
+            AES_init_ctx(&reference, vector.key);
+            AES_ECB_encrypt(&reference, block);
+            if (memcmp(block, vector.cipher, sizeof(block)) != 0) ok = false;
         }
-        return crc;
+        if (!ok) printf("AES self-test FAILED\n");
+        return ok;
     }
 
-    /*
-    Returns the CRC value for the given data frame.
-    Used for whole io-homecontrol frames integrity check
-    */
-    uint16_t radioPacketComputeCrc(uint8_t *buffer, uint8_t bufferLength) {
-        uint16_t crc = 0;
+/**
+ * The `benchAes` function times a block encryption with its key schedule, as every 2W challenge answer
+ * does, with the byte-wise AES against `aes128Encrypt`.
+ */
+    void benchAes(uint16_t rounds) {
+        printf("AES self-test %s\n", aesSelfTest() ? "passed" : "FAILED");
+        uint8_t block[16] = {};
+        volatile uint8_t sink = 0; // Keeps the loops from being optimized out
+
+        int64_t start = esp_timer_get_time();
+        for (uint16_t i = 0; i < rounds; i++) {
+            AES_ctx reference;
+            AES_init_ctx(&reference, transfert_key);
+            AES_ECB_encrypt(&reference, block);
+            sink = sink ^ block[0];
+        }
+        const int64_t byteWise = esp_timer_get_time() - start;
 
-        for (uint8_t i=0; i<bufferLength; i++)
-            crc = computeCrc(buffer[i], crc);
+        start = esp_timer_get_time();
+        for (uint16_t i = 0; i < rounds; i++) {
+            aes128Encrypt(transfert_key, block, block);
+            sink = sink ^ block[0];
+        }
+        const int64_t engine = esp_timer_get_time() - start;
 
-        return crc;
+        printf("AES bench, %u blocks with key schedule:\n", rounds);
+        printf("  byte-wise (crypto2Wutils): %u ns/block\n", static_cast<unsigned>(byteWise * 1000 / rounds));
+        printf("  aes128Encrypt:             %u ns/block\n", static_cast<unsigned>(engine * 1000 / rounds));
+    }
+
+    namespace {
+        // One byte worth of shifts of the reflected CCITT polynomial (CRC-16/KERMIT)
+        constexpr uint16_t crcShift8(uint16_t crc) {
+            for (int i = 0; i < 8; ++i) {
+                unsigned int remainder = (crc & 1) ? CRC_POLYNOMIAL_CCITT : 0;
+                crc = (crc >> 1) ^ remainder;
+            }
+            return crc;
+        }
+
+        struct CrcTable {
+            uint16_t entries[256];
+        };
+
+        constexpr CrcTable makeCrcTable() {
+            CrcTable table{};
+            for (unsigned int i = 0; i < 256; i++)
+                table.entries[i] = crcShift8(i);
+            return table;
+        }
+
+        constexpr CrcTable crcTable = makeCrcTable();
+
+        constexpr uint16_t crcBytes(const uint8_t *data, size_t length, uint16_t crc) {
+            for (size_t i = 0; i < length; i++)
+                crc = (crc >> 8) ^ crcTable.entries[(crc ^ data[i]) & 0xff];
+            return crc;
+        }
+
+        constexpr uint16_t crcBitwise(const uint8_t *data, size_t length, uint16_t crc) {
+            for (size_t i = 0; i < length; i++)
+                crc = crcShift8(crc ^ data[i]);
+            return crc;
+        }
+
+        // Known answers: the CRC-16/KERMIT check value, then 1W frames of the decode logs in iohcRemote1W.
+        // The radio checks and strips the CRC so the logs do not carry it: the last two bytes, low byte first
+        // as on air, come from a reference CRC-16/KERMIT run off target, not from the code below
+        constexpr uint8_t CRC_CHECK[] = {'1', '2', '3', '4', '5', '6', '7', '8', '9'};
+        static_assert(crcBytes(CRC_CHECK, sizeof(CRC_CHECK), 0) == 0x2189, "CRC-16/KERMIT check value");
+
+        constexpr uint8_t CRC_FRAME_14[] = {0xf6, 0x20, 0x00, 0x00, 0x3f, 0xb6, 0x0d, 0x1a, 0x00, 0x01, 0x43, 0xd2, 0x00,
+                                            0x00, 0x00, 0x24, 0x17, 0x9f, 0x18, 0x40, 0x2a, 0xa3, 0x3d, 0x32, 0xbe};
+        constexpr uint8_t CRC_FRAME_16[] = {0xf8, 0x20, 0x00, 0x00, 0x3f, 0xb6, 0x0d, 0x1a, 0x00, 0x01, 0x43, 0xd2, 0x00,
+                                            0x20, 0xcd, 0x2e, 0x00, 0x23, 0xd5, 0xec, 0x80, 0xe4, 0x4b, 0xe6, 0xb6, 0x91, 0x18};
+
+        // Both ways of computing the CRC give the trailing bytes, and a receiver checking the whole frame gets 0
+        constexpr bool crcMatchesFrame(const uint8_t *frame, size_t length) {
+            const uint16_t expected = frame[length - 2] | (frame[length - 1] << 8);
+            return crcBytes(frame, length - 2, 0) == expected && crcBitwise(frame, length - 2, 0) == expected &&
+                   crcBytes(frame, length, 0) == 0;
+        }
+        static_assert(crcMatchesFrame(CRC_FRAME_14, sizeof(CRC_FRAME_14)), "CRC of a 14 bytes 1W frame");
+        static_assert(crcMatchesFrame(CRC_FRAME_16, sizeof(CRC_FRAME_16)), "CRC of a 16 bytes 1W frame");
+    }
+
+    uint16_t computeCrc(uint8_t data, uint16_t crc = 0) {
+        return crcShift8(crc ^ data);
     }
 
     /*
-    Returns the CRC value for the given data frame.
-    Used for whole io-homecontrol frames integrity check
+    Returns the CRC value for the given data frame, one table lookup per byte.
+    Used for whole io-homecontrol frames integrity check: 0 over a frame followed by its CRC.
     */
-    uint16_t radioPacketComputeCrc(std::vector<uint8_t>& buffer) {
-        uint16_t crc = 0;
+    uint16_t radioPacketComputeCrc(const uint8_t *buffer, size_t length, uint16_t crc) {
+        return crcBytes(buffer, length, crc);
+    }
 
-        for (uint8_t buf : buffer)
-            crc = computeCrc(buf, crc);
+/**
+ * The `benchCrc` function times the CRC of a full length frame computed bit by bit, as it used to be,
+ * against the table lookup.
+ */
+    void benchCrc(uint16_t rounds) {
+        uint8_t frame[MAX_CRC_FRAME_LEN];
+        for (size_t i = 0; i < sizeof(frame); i++) frame[i] = static_cast<uint8_t>(i * 37);
+        volatile uint16_t sink = 0; // Keeps the loops from being optimized out
+
+        int64_t start = esp_timer_get_time();
+        for (uint16_t i = 0; i < rounds; i++) {
+            frame[0] = i;
+            sink = sink ^ crcBitwise(frame, sizeof(frame), 0);
+        }
+        const int64_t bitwise = esp_timer_get_time() - start;
 
-        return crc;
+        start = esp_timer_get_time();
+        for (uint16_t i = 0; i < rounds; i++) {
+            frame[0] = i;
+            sink = sink ^ radioPacketComputeCrc(frame, sizeof(frame));
+        }
+        const int64_t table = esp_timer_get_time() - start;
+
+        printf("CRC bench, %u frames of %u bytes:\n", rounds, static_cast<unsigned>(sizeof(frame)));
+        printf("  bit by bit:   %u ns/frame\n", static_cast<unsigned>(bitwise * 1000 / rounds));
+        printf("  table lookup: %u ns/frame\n", static_cast<unsigned>(table * 1000 / rounds));
     }
 
     std::tuple<uint8_t, uint8_t> computeChecksum(uint8_t frame_byte, uint8_t chksum1, uint8_t chksum2) {
@@ -101,17 +246,15 @@ namespace iohcCrypto {
         return std::make_tuple(chksum2^0x55, ((tmpchksum<<1)^0x5b)&0xff);
     }
 
-    std::vector<uint8_t> constructInitialValue(const std::vector<uint8_t>& frame_data, const uint8_t *challenge = nullptr, const uint8_t *sequence_number = nullptr) {
+    bool constructInitialValue(uint8_t *initial_value, const uint8_t *frame_data, size_t length, const uint8_t *challenge = nullptr, const uint8_t *sequence_number = nullptr) {
         if (!challenge && !sequence_number) {
             printf("Cannot create initial value: no mode selected\n");
-            return {};
+            return false;
         }
 
-        std::vector<uint8_t> initial_value(16, 0);
-        initial_value[8] = 0;
-        initial_value[9] = 0;
+        memset(initial_value, 0, 16);
         size_t i = 0;
-        while (i < frame_data.size()) {
+        while (i < length) {
             std::tie(initial_value[8], initial_value[9]) = computeChecksum(frame_data[i], initial_value[8], initial_value[9]);
             if (i < 8)
                 initial_value[i] = frame_data[i];
@@ -134,36 +277,23 @@ namespace iohcCrypto {
                 initial_value[i] = challenge[i - 10];
         }
 
-        return initial_value;
+        return true;
     }
 
 /*
     Calculate HMAC using as input:
     - Packet Sequence Number
     - Controller key in clear
-    - frame data starting from Command byte
+    - frame data starting from Command byte, up to the sequence number
 */
-    void create_1W_hmac(uint8_t *hmac, const uint8_t *seq_number, uint8_t *controller_key, const std::vector<uint8_t>& frame_data) {
-        std::vector<uint8_t> iv;
-        #if defined(HELTEC)
-            mbedtls_aes_init(&aes);
-        #endif
-
-        iv = constructInitialValue(frame_data, nullptr, seq_number);
-
-        #if defined(ESP8266)
-            aes128.setKey(controller_key, 16);
-            aes128.encryptBlock(hmac, iv.data());
-        #elif defined(ESP32)
-            mbedtls_aes_setkey_enc( &aes, controller_key, 128 );
-           
-//        for (uint8_t a=0; a<16; a++){
-//            hmac[a] = 0;
-//        }
-        mbedtls_aes_crypt_ecb(&aes, MBEDTLS_AES_ENCRYPT, iv.data(), hmac);
-//        mbedtls_aes_free( &aes );
-        #endif        
+    void create_1W_hmac(uint8_t *hmac, const uint8_t *seq_number, const uint8_t *controller_key, const uint8_t *frame_data, size_t length) {
+        uint8_t iv[16];
+        constructInitialValue(iv, frame_data, length, nullptr, seq_number);
+        aes128Encrypt(controller_key, iv, hmac);
+    }
 
+    void create_1W_hmac(uint8_t *hmac, const uint8_t *seq_number, uint8_t *controller_key, const std::vector<uint8_t>& frame_data) {
+        create_1W_hmac(hmac, seq_number, controller_key, frame_data.data(), frame_data.size());
     }
 
 /*
@@ -172,16 +302,7 @@ namespace iohcCrypto {
     - Key in clear (or encrypted to decrypt)
 */
     void encrypt_1W_key(const uint8_t *node_address, uint8_t *key) {
-        #if defined(ESP32)
-            mbedtls_aes_init(&aes);
-        #endif
-
-        uint8_t btransfer[16];
-        uint8_t captured[16] = {};
-
-        hexStringToBytes(transfer_key, btransfer);
-
-        std::vector<uint8_t> iv(16, 0);
+        uint8_t iv[16];
         for (int i = 0; i < 13; i += 3) {
             iv[i] = node_address[0];
             iv[i + 1] = node_address[1];
@@ -189,27 +310,10 @@ namespace iohcCrypto {
         }
         iv[15] = node_address[0];
 
-    /*  
-        uint8_t captured[16] = {0};
-        aes128.setKey((uint8_t *)btransfer, 16);
-        aes128.encryptBlock(captured, iv.data());
-
+        // CFB (or CTR) over a single block: XOR with the encrypted IV
+        uint8_t captured[16];
+        aes128Encrypt(transfert_key, iv, captured);
         for (int i = 0; i < 16; ++i)
             key[i] ^= captured[i];
-    */
-        #if defined(ESP8266)
-    //  Use CTR encryption instead of AES. It includes xor with the key
-            ctraes128.setKey(btransfer, 16);
-            ctraes128.setIV(iv.data(), 16);
-            ctraes128.setCounterSize(4);
-            ctraes128.encrypt(key, key, 16);
-        #elif defined(ESP32)
-            size_t iv_offset = 0;
-            mbedtls_aes_setkey_enc( &aes, (uint8_t *)btransfer, 128 );
-            mbedtls_aes_crypt_cfb128(&aes, MBEDTLS_AES_ENCRYPT, 16, &iv_offset, iv.data(), (uint8_t *)key, captured);
-            for (int i = 0; i < 16; ++i)
-                key[i] = captured[i];
-            mbedtls_aes_free( &aes );
-        #endif
     }
 }
\ No newline at end of file
@@ -0,0 +1,89 @@
+/*
+   Copyright (c) 2024. CRIDP https://github.com/cridp
+
+   Licensed under the Apache License, Version 2.0 (the "License");
+   you may not use this file except in compliance with the License.
+   You may obtain a copy of the License at
+
+           http://www.apache.org/licenses/LICENSE-2.0
+
+   Unless required by applicable law or agreed to in writing, software
+   distributed under the License is distributed on an "AS IS" BASIS,
+   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+   See the License for the specific language governing permissions and
+   limitations under the License.
+ */
+
+#include <cstdio>
+#include <cstring>
+
+#include <iohcDedupCache.h>
+#include <nvs_helpers.h>
+
+namespace IOHC {
+/**
+ * The `begin` function restores the suppression window saved with `setWindowMs`.
+ */
+    void iohcDedupCache::begin() {
+        uint16_t saved = window;
+        if (nvs_read_u16(NVS_KEY_DEDUP_WINDOW, saved))
+            window = saved;
+    }
+
+    void iohcDedupCache::setWindowMs(uint16_t windowMs) {
+        window = windowMs;
+        nvs_write_u16(NVS_KEY_DEDUP_WINDOW, window);
+    }
+
+/**
+ * The `isDuplicate` function checks a received frame against the recently delivered ones.
+ *
+ * @param packet The received frame, its `stamp` is used as reception time.
+ * @return true if the frame is a repeat seen within the window and must not be dispatched again.
+ */
+    bool iohcDedupCache::isDuplicate(const iohcPacket *packet) {
+        const auto &header = packet->payload.packet.header;
+        if (!window || !header.CtrlByte1.asStruct.Protocol || packet->buffer_length <= sizeof(_header))
+            return false;
+
+        uint8_t tailLen = packet->buffer_length - sizeof(_header);
+        if (tailLen > DEDUP_KEY_TAIL_LEN) tailLen = DEDUP_KEY_TAIL_LEN;
+        const uint8_t *tail = packet->payload.buffer + packet->buffer_length - tailLen;
+        const unsigned long windowUs = window * 1000UL;
+
+        // Reuse a free entry, otherwise the oldest one
+        entry *victim = nullptr;
+        for (auto &e : entries) {
+            if (!e.used) {
+                if (!victim || victim->used) victim = &e;
+                continue;
+            }
+            if (packet->stamp - e.firstSeen <= windowUs && e.cmd == header.cmd && e.tailLen == tailLen &&
+                !memcmp(e.source, header.source, sizeof(address)) && !memcmp(e.tail, tail, tailLen)) {
+                e.repeats++;
+                suppressed++;
+                return true;
+            }
+            if (!victim || (victim->used && packet->stamp - e.firstSeen > packet->stamp - victim->firstSeen))
+                victim = &e;
+        }
+
+        victim->used = true;
+        memcpy(victim->source, header.source, sizeof(address));
+        victim->cmd = header.cmd;
+        victim->tailLen = tailLen;
+        memcpy(victim->tail, tail, tailLen);
+        victim->firstSeen = packet->stamp;
+        victim->repeats = 0;
+        delivered++;
+        return false;
+    }
+
+    void iohcDedupCache::dump() const {
+        if (!window)
+            printf("Dedup: off, every copy delivered\n");
+        else
+            printf("Dedup: window %ums, %u delivered, %u repeats suppressed\n", window,
+                   static_cast<unsigned>(delivered), static_cast<unsigned>(suppressed));
+    }
+}
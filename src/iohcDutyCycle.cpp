@@ -0,0 +1,139 @@
+/*
+   Copyright (c) 2024. CRIDP https://github.com/cridp
+
+   Licensed under the Apache License, Version 2.0 (the "License");
+   you may not use this file except in compliance with the License.
+   You may obtain a copy of the License at
+
+           http://www.apache.org/licenses/LICENSE-2.0
+
+   Unless required by applicable law or agreed to in writing, software
+   distributed under the License is distributed on an "AS IS" BASIS,
+   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+   See the License for the specific language governing permissions and
+   limitations under the License.
+ */
+
+#include <cstdio>
+#include "esp_timer.h"
+
+#include <iohcDutyCycle.h>
+
+namespace IOHC {
+    namespace {
+        struct SubBand {
+            const char *name;
+            uint32_t low;
+            uint32_t high;
+            uint16_t permille;      // Duty-cycle limit in 1/1000
+        };
+
+        // Unknown frequencies get the strictest limit
+        const SubBand subBands[DUTY_BANDS] = {
+            {"868.0-868.6", 868000000, 868600000, 10},
+            {"868.7-869.2", 868700000, 869200000, 1},
+            {"869.7-870.0", 869700000, 870000000, 10},
+            {"other", 0, 0, 1},
+        };
+
+        uint32_t budgetUs(uint8_t band) {
+            return static_cast<uint32_t>(DUTY_BINS * DUTY_BIN_US * subBands[band].permille / 1000);
+        }
+    }
+
+/**
+ * The `airtimeUs` function computes the time on air of one transmission: preamble, sync word,
+ * frame and CRC, every byte sent as 10 bits.
+ */
+    uint32_t iohcDutyCycle::airtimeUs(uint16_t preambleBytes, uint8_t length, uint32_t bitrate) {
+        const uint64_t bits = (static_cast<uint64_t>(preambleBytes) + DUTY_SYNC_BYTES + length + DUTY_CRC_BYTES) *
+                              DUTY_BITS_PER_BYTE;
+        return static_cast<uint32_t>(bits * 1000000ULL / bitrate);
+    }
+
+    uint8_t iohcDutyCycle::bandOf(uint32_t frequency) {
+        for (uint8_t band = 0; band < DUTY_BANDS - 1; band++)
+            if (frequency >= subBands[band].low && frequency <= subBands[band].high) return band;
+        return DUTY_BANDS - 1;
+    }
+
+/**
+ * The `advance` function moves the current bin to the minute of `nowUs`, clearing the bins that
+ * fell out of the rolling hour. The caller must hold `mux`.
+ */
+    void iohcDutyCycle::advance(int64_t nowUs) {
+        const int64_t minute = nowUs / DUTY_BIN_US;
+        int64_t steps = minute - currentMinute;
+        if (steps <= 0) return;
+        if (steps > DUTY_BINS) steps = DUTY_BINS;
+        while (steps--) {
+            currentBin = (currentBin + 1) % DUTY_BINS;
+            for (auto &band : bins) band[currentBin] = 0;
+        }
+        currentMinute = minute;
+    }
+
+    uint32_t iohcDutyCycle::usedUs(uint8_t band) const {
+        uint32_t used = 0;
+        for (const auto bin : bins[band]) used += bin;
+        return used;
+    }
+
+    void iohcDutyCycle::record(uint32_t frequency, uint32_t airtimeUs) {
+        const int64_t now = esp_timer_get_time();
+        portENTER_CRITICAL(&mux);
+        advance(now);
+        bins[bandOf(frequency)][currentBin] += airtimeUs;
+        portEXIT_CRITICAL(&mux);
+    }
+
+/**
+ * The `isLow` function tells whether the sub-band of `frequency` has less than DUTY_LOW_PERCENT of
+ * its hourly budget left.
+ */
+    bool iohcDutyCycle::isLow(uint32_t frequency) {
+        const uint8_t band = bandOf(frequency);
+        const int64_t now = esp_timer_get_time();
+        portENTER_CRITICAL(&mux);
+        advance(now);
+        const uint32_t used = usedUs(band);
+        portEXIT_CRITICAL(&mux);
+        const uint32_t budget = budgetUs(band);
+        return used >= budget || budget - used < budget / 100 * DUTY_LOW_PERCENT;
+    }
+
+    void iohcDutyCycle::toJson(JsonArray &root) {
+        uint32_t used[DUTY_BANDS];
+        const int64_t now = esp_timer_get_time();
+        portENTER_CRITICAL(&mux);
+        advance(now);
+        for (uint8_t band = 0; band < DUTY_BANDS; band++) used[band] = usedUs(band);
+        portEXIT_CRITICAL(&mux);
+        for (uint8_t band = 0; band < DUTY_BANDS; band++) {
+            const uint32_t budget = budgetUs(band);
+            JsonObject obj = root.add<JsonObject>();
+            obj["band"] = subBands[band].name;
+            obj["limit"] = subBands[band].permille / 10.0f;
+            obj["usedMs"] = used[band] / 1000;
+            obj["budgetMs"] = budget / 1000;
+            obj["remaining"] = used[band] >= budget ? 0.0f : 100.0f * (budget - used[band]) / budget;
+        }
+    }
+
+    void iohcDutyCycle::dump() {
+        uint32_t used[DUTY_BANDS];
+        const int64_t now = esp_timer_get_time();
+        portENTER_CRITICAL(&mux);
+        advance(now);
+        for (uint8_t band = 0; band < DUTY_BANDS; band++) used[band] = usedUs(band);
+        portEXIT_CRITICAL(&mux);
+        printf("Duty cycle over the last hour, background traffic deferred %u times\n", static_cast<unsigned>(deferred));
+        for (uint8_t band = 0; band < DUTY_BANDS; band++) {
+            const uint32_t budget = budgetUs(band);
+            printf("  %-12s %4.1f%%: %6ums of %6ums used, %5.1f%% left\n", subBands[band].name,
+                   subBands[band].permille / 10.0f, static_cast<unsigned>(used[band] / 1000),
+                   static_cast<unsigned>(budget / 1000),
+                   used[band] >= budget ? 0.0f : 100.0f * (budget - used[band]) / budget);
+        }
+    }
+}
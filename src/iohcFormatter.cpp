@@ -0,0 +1,107 @@
+/*
+   Copyright (c) 2024. CRIDP https://github.com/cridp
+
+   Licensed under the Apache License, Version 2.0 (the "License");
+   you may not use this file except in compliance with the License.
+   You may obtain a copy of the License at
+
+           http://www.apache.org/licenses/LICENSE-2.0
+
+   Unless required by applicable law or agreed to in writing, software
+   distributed under the License is distributed on an "AS IS" BASIS,
+   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+   See the License for the specific language governing permissions and
+   limitations under the License.
+ */
+
+
+#include <cstring>
+
+#include <iohcFormatter.h>
+
+namespace IOHC {
+    namespace {
+        const char HEX_LOWER[] = "0123456789abcdef";
+        const char HEX_UPPER[] = "0123456789ABCDEF";
+    }
+
+    size_t hexEncode(char *out, const uint8_t *data, size_t len, bool upper) {
+        const char *digits = upper ? HEX_UPPER : HEX_LOWER;
+        for (size_t i = 0; i < len; i++) {
+            *out++ = digits[data[i] >> 4];
+            *out++ = digits[data[i] & 0x0f];
+        }
+        return len * 2;
+    }
+
+    iohcFormatter::iohcFormatter(char *out, size_t size) : out(out), size(size) {
+        if (size) out[0] = '\0';
+    }
+
+    iohcFormatter &iohcFormatter::str(const char *s) {
+        while (*s) chr(*s++);
+        return *this;
+    }
+
+    iohcFormatter &iohcFormatter::chr(char c) {
+        if (len + 1 < size) {
+            out[len++] = c;
+            out[len] = '\0';
+        } else {
+            overflow = true;
+        }
+        return *this;
+    }
+
+/**
+ * The `hex` function appends `len` bytes as two hex digits each, dropping the whole run if it does not
+ * fit rather than leaving a partial byte.
+ */
+    iohcFormatter &iohcFormatter::hex(const uint8_t *data, size_t len, bool upper) {
+        if (this->len + len * 2 < size) {
+            this->len += hexEncode(out + this->len, data, len, upper);
+            out[this->len] = '\0';
+        } else if (len) {
+            overflow = true;
+        }
+        return *this;
+    }
+
+    iohcFormatter &iohcFormatter::hex(uint32_t value, uint8_t width) {
+        char digits[8];
+        uint8_t count = 0;
+        do {
+            digits[count++] = HEX_UPPER[value & 0x0f];
+            value >>= 4;
+        } while (value);
+        while (width > count) {
+            chr(' ');
+            width--;
+        }
+        while (count) chr(digits[--count]);
+        return *this;
+    }
+
+    iohcFormatter &iohcFormatter::hex2(uint8_t value) {
+        return chr(HEX_UPPER[value >> 4]).chr(HEX_UPPER[value & 0x0f]);
+    }
+
+    iohcFormatter &iohcFormatter::dec(uint32_t value, uint8_t width, char fill) {
+        char digits[10];
+        uint8_t count = 0;
+        do {
+            digits[count++] = static_cast<char>('0' + value % 10);
+            value /= 10;
+        } while (value);
+        while (width > count) {
+            chr(fill);
+            width--;
+        }
+        while (count) chr(digits[--count]);
+        return *this;
+    }
+
+    iohcFormatter &iohcFormatter::usAsMs(uint32_t us) {
+        return dec(us / 1000).chr('.').dec(us % 1000, 3, '0');
+    }
+}
@@ -0,0 +1,160 @@
+/*
+   Copyright (c) 2024. CRIDP https://github.com/cridp
+
+   Licensed under the Apache License, Version 2.0 (the "License");
+   you may not use this file except in compliance with the License.
+   You may obtain a copy of the License at
+
+           http://www.apache.org/licenses/LICENSE-2.0
+
+   Unless required by applicable law or agreed to in writing, software
+   distributed under the License is distributed on an "AS IS" BASIS,
+   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+   See the License for the specific language governing permissions and
+   limitations under the License.
+ */
+
+
+#include <cstring>
+
+#include <iohcFrameBuilder.h>
+#include <iohcCryptoHelpers.h>
+
+namespace IOHC {
+/**
+ * The `iohcFrameBuilder` constructor starts a single frame: both control bytes are reset and MsgLen covers
+ * the header only. Addresses and command are left to the caller, the pool hands out cleared packets.
+ */
+    iohcFrameBuilder::iohcFrameBuilder(iohcPacket *packet, bool oneWay) : frame(packet) {
+        auto &header = frame->payload.packet.header;
+        header.CtrlByte1.asByte = 0;
+        header.CtrlByte1.asStruct.Protocol = oneWay;
+        header.CtrlByte1.asStruct.StartFrame = 1;
+        header.CtrlByte1.asStruct.EndFrame = oneWay;
+        header.CtrlByte2.asByte = 0;
+        extend(0);
+    }
+
+    iohcFrameBuilder::iohcFrameBuilder(iohcPacket *packet) : frame(packet) {
+        extend(0);
+    }
+
+    iohcFrameBuilder &iohcFrameBuilder::endFrame(bool end) {
+        frame->payload.packet.header.CtrlByte1.asStruct.EndFrame = end;
+        return *this;
+    }
+
+    iohcFrameBuilder &iohcFrameBuilder::lowPower(bool lpm) {
+        frame->payload.packet.header.CtrlByte2.asStruct.LPM = lpm;
+        return *this;
+    }
+
+    iohcFrameBuilder &iohcFrameBuilder::priority(bool prio) {
+        frame->payload.packet.header.CtrlByte2.asStruct.Prio = prio;
+        return *this;
+    }
+
+    iohcFrameBuilder &iohcFrameBuilder::target(const address node) {
+        memcpy(frame->payload.packet.header.target, node, sizeof(address));
+        return *this;
+    }
+
+    iohcFrameBuilder &iohcFrameBuilder::broadcast(uint16_t group) {
+        const address node = {0x00, static_cast<uint8_t>(group >> 8), static_cast<uint8_t>(group)};
+        return target(node);
+    }
+
+    iohcFrameBuilder &iohcFrameBuilder::source(const address node) {
+        memcpy(frame->payload.packet.header.source, node, sizeof(address));
+        return *this;
+    }
+
+    iohcFrameBuilder &iohcFrameBuilder::command(uint8_t cmd) {
+        frame->payload.packet.header.cmd = cmd;
+        return *this;
+    }
+
+/**
+ * The `layout` function starts the data of a known command variant: the command of layout `id`, and the
+ * data grown to the start of its sequence, where `sign1W` goes on, or to its whole length when unsigned.
+ * The fields are then set with `field` or through the payload structs.
+ */
+    iohcFrameBuilder &iohcFrameBuilder::layout(FrameLayoutId id) {
+        const FrameLayout &variant = frameLayout(id);
+        const FrameFieldDesc *sequence = findFrameDesc(variant, FrameField::Sequence);
+        const size_t length = sequence ? sequence->offset : variant.dataLen;
+        hasLayout = true;
+        layoutId = id;
+        command(variant.cmd);
+        if (length > dataLen) extend(length - dataLen);
+        return *this;
+    }
+
+    iohcFrameBuilder &iohcFrameBuilder::field(FrameField field, uint32_t value) {
+        const FrameFieldDesc *desc = hasLayout ? findFrameDesc(frameLayout(layoutId), field) : nullptr;
+        if (!desc || desc->offset + desc->size > dataLen) {
+            overflow = true;
+            return *this;
+        }
+        writeFrameField(frame->payload.buffer + IOHC_HEADER_LEN, *desc, value);
+        return *this;
+    }
+
+    iohcFrameBuilder &iohcFrameBuilder::byte(uint8_t value) {
+        if (uint8_t *data = reserve(1)) data[0] = value;
+        return *this;
+    }
+
+    iohcFrameBuilder &iohcFrameBuilder::word(uint16_t value) {
+        if (uint8_t *data = reserve(2)) {
+            data[0] = value >> 8;
+            data[1] = value & 0xff;
+        }
+        return *this;
+    }
+
+    iohcFrameBuilder &iohcFrameBuilder::bytes(const uint8_t *data, size_t len) {
+        if (uint8_t *to = reserve(len)) memcpy(to, data, len);
+        return *this;
+    }
+
+    iohcFrameBuilder &iohcFrameBuilder::extend(size_t len) {
+        reserve(len);
+        return *this;
+    }
+
+/**
+ * The `sign1W` function closes a 1W frame: the rolling sequence number, then the first bytes of the AES
+ * of the IV built from the command, the data before the sequence and the sequence itself.
+ */
+    iohcFrameBuilder &iohcFrameBuilder::sign1W(uint16_t sequence, const uint8_t *key) {
+        const size_t signedLen = 1 + dataLen; // Command and data
+        uint8_t *seq = reserve(2);
+        uint8_t *mac = reserve(IOHC_1W_MAC_LEN);
+        if (!seq || !mac) return *this;
+        seq[0] = sequence >> 8;
+        seq[1] = sequence & 0xff;
+
+        uint8_t hmac[16];
+        iohcCrypto::create_1W_hmac(hmac, seq, key, &frame->payload.packet.header.cmd, signedLen);
+        memcpy(mac, hmac, IOHC_1W_MAC_LEN);
+        return *this;
+    }
+
+/**
+ * The `reserve` function grows the data by `len` bytes and keeps MsgLen and buffer_length in step.
+ *
+ * @return The first reserved byte, nullptr when the frame would overflow.
+ */
+    uint8_t *iohcFrameBuilder::reserve(size_t len) {
+        if (overflow || IOHC_HEADER_LEN + dataLen + len > MAX_FRAME_LEN) {
+            overflow = true;
+            return nullptr;
+        }
+        uint8_t *data = frame->payload.buffer + IOHC_HEADER_LEN + dataLen;
+        dataLen += len;
+        frame->payload.packet.header.CtrlByte1.asStruct.MsgLen = IOHC_HEADER_LEN - 1 + dataLen;
+        frame->buffer_length = IOHC_HEADER_LEN + dataLen;
+        return data;
+    }
+}
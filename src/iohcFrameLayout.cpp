@@ -0,0 +1,87 @@
+/*
+   Copyright (c) 2024. CRIDP https://github.com/cridp
+
+   Licensed under the Apache License, Version 2.0 (the "License");
+   you may not use this file except in compliance with the License.
+   You may obtain a copy of the License at
+
+           http://www.apache.org/licenses/LICENSE-2.0
+
+   Unless required by applicable law or agreed to in writing, software
+   distributed under the License is distributed on an "AS IS" BASIS,
+   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+   See the License for the specific language governing permissions and
+   limitations under the License.
+ */
+
+
+#include <iohcFrameLayout.h>
+
+namespace IOHC {
+    namespace {
+        // Distinct bytes per field, so a field overlapping another one cannot read back its own value
+        constexpr uint32_t fieldPattern(uint8_t index, uint8_t size) {
+            uint32_t value = 0;
+            for (uint8_t i = 0; i < size; i++) value = value << 8 | static_cast<uint8_t>(0x10 * (index + 1) + i);
+            return value;
+        }
+
+        /** Writes every numeric field of `layout` with the builder, then reads them back with the parser. */
+        constexpr bool layoutRoundTrips(const FrameLayout &layout) {
+            uint8_t data[MAX_FRAME_LEN - IOHC_HEADER_LEN] = {};
+            for (uint8_t i = 0; i < layout.fieldCount; i++)
+                if (layout.fields[i].size <= 4) writeFrameField(data, layout.fields[i], fieldPattern(i, layout.fields[i].size));
+            for (uint8_t i = 0; i < layout.fieldCount; i++)
+                if (layout.fields[i].size <= 4 && readFrameField(data, layout.fields[i]) != fieldPattern(i, layout.fields[i].size))
+                    return false;
+            return true;
+        }
+    }
+
+#define IOHC_LAYOUT_CHECK(id, oneWay, cmd, len, type, fields, flags) \
+    static_assert(IOHC_HEADER_LEN + sizeof(type) <= MAX_FRAME_LEN, #type " does not fit in a frame"); \
+    static_assert(layoutIsDense(frameLayout(FrameLayoutId::id), sizeof(type)), #id " fields do not cover " #type); \
+    static_assert(layoutRoundTrips(frameLayout(FrameLayoutId::id)), #id " fields do not round trip");
+    IOHC_FRAME_LAYOUTS(IOHC_LAYOUT_CHECK)
+#undef IOHC_LAYOUT_CHECK
+    static_assert(sizeof(FRAME_LAYOUTS) / sizeof(FrameLayout) == static_cast<uint8_t>(FrameLayoutId::Count),
+                  "One layout per id");
+
+    const FrameLayout *findFrameLayout(bool oneWay, uint8_t cmd, uint8_t dataLen) {
+        for (const auto &layout : FRAME_LAYOUTS) {
+            if (layout.oneWay == oneWay && layout.cmd == cmd &&
+                (layout.dataLen == dataLen || (layout.flags & LAYOUT_ANY_LEN && dataLen >= layout.dataLen)))
+                return &layout;
+        }
+        return nullptr;
+    }
+
+    const FrameLayout *findFrameLayout(const iohcPacket *packet) {
+        const auto &header = packet->payload.packet.header;
+        const uint8_t dataLen = packet->buffer_length > IOHC_HEADER_LEN ? packet->buffer_length - IOHC_HEADER_LEN : 0;
+        return findFrameLayout(header.CtrlByte1.asStruct.Protocol, header.cmd, dataLen);
+    }
+
+/**
+ * The `frameField` function reads a numeric field of a received or forged frame through its layout.
+ *
+ * @param size Set to the size of the field on air when not null, fields over 4 bytes are truncated.
+ * @return false when the frame has no known layout or the layout no such field.
+ */
+    bool frameField(const iohcPacket *packet, FrameField field, uint32_t &value, uint8_t *size) {
+        const FrameLayout *layout = findFrameLayout(packet);
+        if (!layout) return false;
+        const FrameFieldDesc *desc = findFrameDesc(*layout, field);
+        if (!desc) return false;
+        value = readFrameField(packet->payload.buffer + IOHC_HEADER_LEN, *desc);
+        if (size) *size = desc->size;
+        return true;
+    }
+
+    const char *frameFieldName(FrameField field) {
+        static const char *const names[] = {"Org", "Acei", "Main", "fp1", "fp2", "fp3", "Data", "SEQ", "MAC",
+                                            "KEY", "MANU", "Actuator", "Backbone", "Info", "Stamp"};
+        static_assert(sizeof(names) / sizeof(names[0]) == static_cast<uint8_t>(FrameField::Count), "One name per field");
+        return names[static_cast<uint8_t>(field)];
+    }
+}
@@ -0,0 +1,88 @@
+/*
+   Copyright (c) 2024. CRIDP https://github.com/cridp
+
+   Licensed under the Apache License, Version 2.0 (the "License");
+   you may not use this file except in compliance with the License.
+   You may obtain a copy of the License at
+
+           http://www.apache.org/licenses/LICENSE-2.0
+
+   Unless required by applicable law or agreed to in writing, software
+   distributed under the License is distributed on an "AS IS" BASIS,
+   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+   See the License for the specific language governing permissions and
+   limitations under the License.
+ */
+
+#include <cstdio>
+
+#include <iohcHopPolicy.h>
+
+namespace IOHC {
+/**
+ * The `begin` function sets the number of scanned channels and the base dwell time and clears the history.
+ */
+    void iohcHopPolicy::begin(uint8_t channels, uint32_t baseDwell) {
+        numChannels = channels > HOP_MAX_CHANNELS ? HOP_MAX_CHANNELS : (channels ? channels : 1);
+        baseDwellUs = baseDwell;
+        for (uint8_t ch = 0; ch < HOP_MAX_CHANNELS; ch++) {
+            activity[ch] = 0;
+            frames[ch] = 0;
+            preambles[ch] = 0;
+        }
+    }
+
+    void iohcHopPolicy::setAdaptive(bool enable) {
+        adaptive = enable;
+    }
+
+    void iohcHopPolicy::onPreamble(uint8_t channel) {
+        if (channel >= numChannels) return;
+        preambles[channel]++;
+        activity[channel] += HOP_PREAMBLE_WEIGHT;
+    }
+
+    void iohcHopPolicy::onFrame(uint8_t channel) {
+        if (channel >= numChannels) return;
+        frames[channel]++;
+        activity[channel] += HOP_FRAME_WEIGHT;
+    }
+
+/**
+ * The `onCycleEnd` function ages the activity of every channel once all of them have been visited,
+ * so the split follows recent traffic rather than the whole uptime.
+ */
+    void iohcHopPolicy::onCycleEnd() {
+        for (uint8_t ch = 0; ch < numChannels; ch++)
+            // Rounded up, so a quiet channel gets back to 0 instead of sticking below 1 << HOP_DECAY_SHIFT
+            activity[ch] -= (activity[ch] + (1u << HOP_DECAY_SHIFT) - 1) >> HOP_DECAY_SHIFT;
+    }
+
+/**
+ * The `dwellUs` function returns how long the receiver stays on `channel` before hopping.
+ *
+ * @return The base dwell in fixed mode, otherwise the channel floor plus its activity share of the rest of the cycle.
+ */
+    uint32_t iohcHopPolicy::dwellUs(uint8_t channel) const {
+        if (!adaptive || numChannels < 2 || channel >= numChannels) return baseDwellUs;
+
+        const uint32_t cycleUs = baseDwellUs * numChannels;
+        uint32_t floorUs = cycleUs * HOP_MIN_DWELL_PERCENT / 100;
+        if (floorUs * numChannels > cycleUs) floorUs = baseDwellUs;
+        const uint32_t sharedUs = cycleUs - floorUs * numChannels;
+
+        // +1 keeps the split even while nothing has been heard
+        uint32_t total = 0;
+        for (uint8_t ch = 0; ch < numChannels; ch++) total += activity[ch] + 1;
+
+        return floorUs + static_cast<uint32_t>(static_cast<uint64_t>(sharedUs) * (activity[channel] + 1) / total);
+    }
+
+    void iohcHopPolicy::dump() const {
+        printf("Hopping: %s, base dwell %uus\n", adaptive ? "adaptive" : "fixed", static_cast<unsigned>(baseDwellUs));
+        for (uint8_t ch = 0; ch < numChannels; ch++)
+            printf("  ch%u: dwell %uus, activity %u, frames %u, preambles %u\n", ch,
+                   static_cast<unsigned>(dwellUs(ch)), static_cast<unsigned>(activity[ch]),
+                   static_cast<unsigned>(frames[ch]), static_cast<unsigned>(preambles[ch]));
+    }
+}
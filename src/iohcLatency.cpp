@@ -0,0 +1,61 @@
+/*
+   Copyright (c) 2024. CRIDP https://github.com/cridp
+
+   Licensed under the Apache License, Version 2.0 (the "License");
+   you may not use this file except in compliance with the License.
+   You may obtain a copy of the License at
+
+           http://www.apache.org/licenses/LICENSE-2.0
+
+   Unless required by applicable law or agreed to in writing, software
+   distributed under the License is distributed on an "AS IS" BASIS,
+   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+   See the License for the specific language governing permissions and
+   limitations under the License.
+ */
+
+#include <cstdio>
+
+#include <iohcLatency.h>
+
+namespace IOHC {
+    void iohcLatencyHistogram::record(uint32_t us) {
+        // Bucket n holds [2^(n-1), 2^n) uS, bucket 0 holds 0
+        uint8_t idx = us ? 32 - __builtin_clz(us) : 0;
+        if (idx >= LATENCY_BUCKETS) idx = LATENCY_BUCKETS - 1;
+        buckets[idx]++;
+        samples++;
+        if (us > maxUs) maxUs = us;
+    }
+
+    void iohcLatencyHistogram::reset() {
+        for (auto &bucket : buckets) bucket = 0;
+        samples = 0;
+        maxUs = 0;
+    }
+
+/**
+ * The `percentile` function walks the buckets until `pct` percent of the samples are covered.
+ *
+ * @return The upper bound in uS of the bucket reaching the percentile, 0 if nothing was recorded.
+ */
+    uint32_t iohcLatencyHistogram::percentile(uint8_t pct) const {
+        if (!samples) return 0;
+        const uint64_t wanted = (static_cast<uint64_t>(samples) * pct + 99) / 100;
+        uint64_t seen = 0;
+        for (uint8_t idx = 0; idx < LATENCY_BUCKETS; idx++) {
+            seen += buckets[idx];
+            if (seen >= wanted) {
+                const uint32_t upper = (1UL << idx) - 1;
+                return (idx == LATENCY_BUCKETS - 1 || upper > maxUs) ? maxUs : upper;
+            }
+        }
+        return maxUs;
+    }
+
+    void iohcLatencyHistogram::print(const char *name) const {
+        printf("%-22s n=%u p50<=%uus p90<=%uus p99<=%uus max=%uus\n", name, static_cast<unsigned>(samples),
+               static_cast<unsigned>(percentile(50)), static_cast<unsigned>(percentile(90)),
+               static_cast<unsigned>(percentile(99)), static_cast<unsigned>(maxUs));
+    }
+}
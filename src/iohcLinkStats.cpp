@@ -0,0 +1,132 @@
+/*
+   Copyright (c) 2024. CRIDP https://github.com/cridp
+
+   Licensed under the Apache License, Version 2.0 (the "License");
+   you may not use this file except in compliance with the License.
+   You may obtain a copy of the License at
+
+           http://www.apache.org/licenses/LICENSE-2.0
+
+   Unless required by applicable law or agreed to in writing, software
+   distributed under the License is distributed on an "AS IS" BASIS,
+   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+   See the License for the specific language governing permissions and
+   limitations under the License.
+ */
+
+#include <cstdio>
+#include <cstring>
+#include "esp_timer.h"
+
+#include <iohcLinkStats.h>
+#include <iohcCryptoHelpers.h>
+
+namespace IOHC {
+    uint8_t iohcLinkStats::channelIndex(uint32_t frequency) {
+        switch (frequency) {
+            case CHANNEL1: return 0;
+            case CHANNEL2: return 1;
+            case CHANNEL3: return 2;
+            default: return 3;
+        }
+    }
+
+/**
+ * The `record` function accounts a received frame to its source device, taking over the slot of the
+ * least recently heard device when the table is full. A frame failing its CRC only counts against a device
+ * already known, its source address may be corrupted.
+ */
+    void iohcLinkStats::record(const iohcPacket *packet) {
+        const uint8_t *node = packet->payload.packet.header.source;
+        const uint32_t nowS = static_cast<uint32_t>(esp_timer_get_time() / 1000000LL);
+        const auto rssi = static_cast<int16_t>(packet->rssi);
+
+        portENTER_CRITICAL(&mux);
+        entry *slot = nullptr;
+        entry *oldest = &entries[0];
+        for (auto &e : entries) {
+            if (e.used && !memcmp(e.node, node, sizeof(address))) {
+                slot = &e;
+                break;
+            }
+            if (!e.used) {
+                if (oldest->used) oldest = &e;
+            } else if (oldest->used && e.lastSeenS < oldest->lastSeenS) {
+                oldest = &e;
+            }
+        }
+        if (packet->rxErrors & RX_ERROR_CRC) {
+            // Nothing else of the frame is trusted
+            if (slot) slot->crcErrors++;
+            else unknownCrcErrors++;
+            portEXIT_CRITICAL(&mux);
+            return;
+        }
+        if (!slot) {
+            slot = oldest;
+            memset(slot, 0, sizeof(entry));
+            slot->used = true;
+            memcpy(slot->node, node, sizeof(address));
+            slot->rssiEwmaX16 = rssi * 16;
+        }
+
+        slot->rssiEwmaX16 += (rssi * 16 - slot->rssiEwmaX16) / (1 << LINK_STATS_EWMA_SHIFT);
+        slot->lastRssi = rssi;
+        slot->lastAfc = static_cast<int32_t>(packet->afc);
+        slot->lastSeenS = nowS;
+        slot->frames[channelIndex(packet->frequency)]++;
+        if (packet->rxErrors & RX_ERROR_LENGTH) slot->lengthErrors++;
+        portEXIT_CRITICAL(&mux);
+    }
+
+/**
+ * The `snapshot` function copies the used entries so they can be formatted outside the lock.
+ *
+ * @return The number of entries copied into `out`.
+ */
+    size_t iohcLinkStats::snapshot(entry *out, size_t max) {
+        size_t count = 0;
+        portENTER_CRITICAL(&mux);
+        for (const auto &e : entries) {
+            if (count >= max) break;
+            if (e.used) out[count++] = e;
+        }
+        portEXIT_CRITICAL(&mux);
+        return count;
+    }
+
+    void iohcLinkStats::toJson(JsonArray &root) {
+        entry copy[LINK_STATS_DEVICES];
+        const size_t count = snapshot(copy, LINK_STATS_DEVICES);
+        const uint32_t nowS = static_cast<uint32_t>(esp_timer_get_time() / 1000000LL);
+        for (size_t i = 0; i < count; i++) {
+            const entry &e = copy[i];
+            JsonObject obj = root.add<JsonObject>();
+            obj["address"] = bytesToHexString(e.node, sizeof(e.node));
+            obj["rssi"] = e.rssiEwmaX16 / 16.0f;
+            obj["lastRssi"] = e.lastRssi;
+            obj["afc"] = e.lastAfc;
+            obj["age"] = nowS - e.lastSeenS;
+            JsonArray frames = obj["frames"].to<JsonArray>();
+            for (const auto frameCount : e.frames) frames.add(frameCount);
+            obj["crcErrors"] = e.crcErrors;
+            obj["lengthErrors"] = e.lengthErrors;
+        }
+    }
+
+    void iohcLinkStats::dump() {
+        entry copy[LINK_STATS_DEVICES];
+        const size_t count = snapshot(copy, LINK_STATS_DEVICES);
+        const uint32_t nowS = static_cast<uint32_t>(esp_timer_get_time() / 1000000LL);
+        printf("Address  RSSI(avg) Last  Age(s)  Ch1/Ch2/Ch3/Other  CRC/Len errors\n");
+        for (size_t i = 0; i < count; i++) {
+            const entry &e = copy[i];
+            printf("%s %6.1f  %4d  %6u  %u/%u/%u/%u  %u/%u\n", bytesToHexString(e.node, sizeof(e.node)).c_str(),
+                   e.rssiEwmaX16 / 16.0f, e.lastRssi, static_cast<unsigned>(nowS - e.lastSeenS),
+                   static_cast<unsigned>(e.frames[0]), static_cast<unsigned>(e.frames[1]),
+                   static_cast<unsigned>(e.frames[2]), static_cast<unsigned>(e.frames[3]),
+                   e.crcErrors, e.lengthErrors);
+        }
+        printf("CRC errors from unknown addresses: %u\n", static_cast<unsigned>(unknownCrcErrors));
+    }
+}
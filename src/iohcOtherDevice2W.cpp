@@ -18,6 +18,7 @@
 #include <LittleFS.h>
 #include <ArduinoJson.h>
 #include <iohcCryptoHelpers.h>
+#include <iohcFrameBuilder.h>
 #include <string>
 #include <iohcRadio.h>
 #include <vector>
@@ -40,34 +41,161 @@ namespace IOHC {
 
     address fake_gateway = {0xba, 0x11, 0xad};
 
-    void iohcOtherDevice2W::forgePacket(iohcPacket *packet, const std::vector<uint8_t> &toSend, size_t typn = 0) {
+    bool iohcOtherDevice2W::forgePacket(iohcPacket *packet, const std::vector<uint8_t> &toSend, size_t typn = 0) {
         digitalWrite(RX_LED, digitalRead(RX_LED) ^ 1);
         IOHC::relStamp = esp_timer_get_time();
 
-        packet->payload.packet.header.CtrlByte1.asStruct.MsgLen = sizeof(_header) - 1;
-
-        packet->payload.packet.header.cmd = 0x2A; //0x28; //typn;
-        // Common Flags
-        packet->payload.packet.header.CtrlByte1.asStruct.EndFrame = 0;
+        // Common Flags, protocol and start frame are kept from a frame loaded before (discovery)
         packet->payload.packet.header.CtrlByte2.asByte = 0;
-        packet->payload.packet.header.CtrlByte2.asStruct.Prio = 1;
-        packet->payload.packet.header.CtrlByte2.asStruct.LPM = 0;
-
-        // Broadcast Target
-        u_int16_t bcast = typn;
         //            uint16_t bcast = /*(_type.at(typn)<<6)*/(typn)<<6 + 0b111111;
-        packet->payload.packet.header.target[0] = 0x00;
-        packet->payload.packet.header.target[1] = bcast >> 8;
-        packet->payload.packet.header.target[2] = bcast & 0x00ff;
-
-        packet->payload.packet.header.CtrlByte1.asByte += toSend.size();
-        memcpy(packet->payload.buffer + 9, toSend.data(), toSend.size());
-        packet->buffer_length = toSend.size() + 9;
+        const bool truncated = iohcFrameBuilder(packet).command(0x2A) //0x28; //typn;
+                .endFrame(false).priority(true).lowPower(false)
+                .broadcast(typn)
+                .bytes(toSend.data(), toSend.size())
+                .truncated();
+        if (truncated) {
+            printf("ERROR: 2W frame truncated (%u bytes), not sent\n", static_cast<unsigned>(toSend.size()));
+            return false;
+        }
 
         packet->frequency = CHANNEL2;
         packet->repeatTime = 50;
         packet->repeat = 0;
         packet->lock = false;
+        return true;
+    }
+
+/**
+ * The `startScan` function starts a discovery, custom ACEI or command check scan. Steps are queued by chunks of
+ * OTHER_2W_SCAN_CHUNK from the completion of the previous chunk, so a scan never holds more of the
+ * packet pool than a chunk and no step is dropped. A new scan replaces the one in progress.
+ */
+    void iohcOtherDevice2W::startScan(ScanKind kind) {
+        scanKind = kind;
+        scanStep = 0;
+        scanId++;
+        digitalWrite(RX_LED, digitalRead(RX_LED) ^ 1);
+        sendScanChunk();
+    }
+
+    void iohcOtherDevice2W::sendScanChunk() {
+        const int last = scanKind == ScanKind::Discovery ? 255
+                         : scanKind == ScanKind::Check ? static_cast<int>(scanCmds.size()) : 256;
+        std::vector<iohcPacketHandle> packets2send;
+        while (scanStep < last && packets2send.size() < OTHER_2W_SCAN_CHUNK) {
+            if (scanKind == ScanKind::Custom) {
+                AceiUnion ACEI{};
+                ACEI.asByte = scanStep;
+                // Only other ACEI are valids, other give answer: 0xFE 0x58
+                if (!ACEI.asStruct.isvalid || ACEI.asStruct.service != 0) { scanStep++; continue; }
+            }
+            auto packet = iohcPacketPool::acquire();
+            if (!packet) break;
+            // A step that does not fit a frame is skipped, the packet goes back to the pool
+            if (forgeScanStep(packet.get(), scanStep++)) packets2send.push_back(std::move(packet));
+        }
+        if (packets2send.empty()) {
+            if (scanStep < last)
+                Serial.printf("Scan stopped at step %d/%d, no free TX packet\n", scanStep, last);
+            scanKind = ScanKind::None;
+            return;
+        }
+        const uint32_t id = scanId;
+        _radioInstance->send(packets2send, TxPriority::Background, 0, [this, id](const TxReport &report) {
+            // Runs in the TX engine once the chunk is on air, another scan may have started meanwhile
+            if (report.status == TxStatus::Sent && scanId == id) sendScanChunk();
+        });
+    }
+
+    bool iohcOtherDevice2W::forgeScanStep(iohcPacket *packet, int step) {
+        if (scanKind == ScanKind::Check) {
+            const uint8_t cmd = scanCmds[step];
+            std::vector<uint8_t> toSend;
+            uint8_t special12[] = {
+                0x01, 0x02, 0x03, 0x04, 0x05, 0x06, 0x07, 0x08, 0x09, 0x10, 0x11, 0x12, 0x13, 0x14, 0x15, 0x16,
+                0x17, 0x18, 0x19, 0x20, 0x21
+            };
+            uint8_t specacei[] = {0x01, 0xe7, 0x00, 0x00, 0x00, 0x00};
+
+            // 0x00,  0x01, 0x03, 0x0a, 0x0c, 0x19, 0x1e, 0x20, 0x23, 0x28, 0x2a(12), 0x2c, 0x2e, 0x31, 0x32(16), 0x36, 0x38(6), 0x39, 0x3c(6), 0x46(9), 0x48(9), 0x4a(18), 0x4b
+            // ,0x50, 0x52(16), 0x54, 0x56, 0x60(21), 0x64(2), 0x6e(9), 0x6f(9), 0x71, 0x73(3), 0x80, 0x82(21), 0x84, 0x86, 0x88, 0x8a(18), 0x8b(1), 0x8e, 0x90, 0x92(16), 0x94, 0x96(12), 0x98
+            if (cmd == 0x00 || cmd == 0x01 || cmd == 0x0B || cmd == 0x0E || cmd == 0x23 || cmd == 0x2A || cmd == 0x1E)
+                toSend.assign(specacei, specacei + 6);
+            if (cmd == 0x8B || cmd == 0x19)
+                toSend.assign(special12, special12 + 1);
+            if (cmd == 0x04) toSend.assign(special12, special12 + 14);
+            uint8_t special03[] = {0x03, 0x00, 0x00};
+            if (cmd == 0x03 || cmd == 0x73)
+                toSend.assign(special03, special03 + 3);
+            uint8_t special0C[] = {0xD8, 0x00, 0x00, 0x00};
+            if (cmd == 0x0C)
+                toSend.assign(special0C, special0C + 4);
+            uint8_t special0D[] = {0x05, 0xaa, 0x0d, 0x00, 0x00};
+            if (cmd == 0x0D)
+                toSend.assign(special0D, special0D + 5);
+            if (cmd == 0x64 || cmd == 0x14)
+                toSend.assign(special12, special12 + 2);
+            if (cmd == 0x2A || cmd == 0x96)
+                toSend.assign(special12, special12 + 12);
+            if (cmd == 0x38 || cmd == 0x3C || cmd == 0x3D)
+                toSend.assign(special12, special12 + 6);
+            if (cmd == 0x32 || cmd == 0x52 || cmd == 0x92)
+                toSend.assign(special12, special12 + 16);
+            if (cmd == 0x46 || cmd == 0x48 || cmd == 0x6E || cmd == 0x6F)
+                toSend.assign(special12, special12 + 9);
+            if (cmd == 0x4A || cmd == 0x8A)
+                toSend.assign(special12, special12 + 18);
+            if (cmd == 0x60 || cmd == 0x82)
+                toSend.assign(special12, special12 + 21);
+
+            if (!forgePacket(packet, toSend)) return false;
+            packet->payload.packet.header.cmd = cmd;
+            memorizeOther2W.memorizedCmd = cmd;
+
+            packet->payload.packet.header.CtrlByte1.asStruct.StartFrame = 1;
+            packet->payload.packet.header.CtrlByte1.asStruct.EndFrame = 0;
+            packet->payload.packet.header.CtrlByte2.asStruct.LPM = 1;
+            packet->payload.packet.header.CtrlByte2.asStruct.Prio = 1;
+
+            memcpy(packet->payload.packet.header.source, gateway, 3);
+            memcpy(packet->payload.packet.header.target, master_to, 3);
+
+            packet->repeatTime = 250; // Slow down discover loop
+            packet->delayed = 250;   // Give enough time for the answer
+            return true;
+        }
+        if (scanKind == ScanKind::Discovery) {
+            std::string discovery = "d430477706ba11ad31"; //28"; //"2b578ebc37334d6e2f50a4dfa9";
+            std::vector<uint8_t> toSend = {};
+            packet->buffer_length = hexStringToBytes(discovery, packet->payload.buffer);
+            if (!forgePacket(packet, toSend, step)) return false;
+            packet->repeatTime = 250; // Slow down discovery loop
+            return true;
+        }
+
+        std::vector<uint8_t> toSend = {0x01, 0x47, 0xc8, 0x00, 0x00, 0x00};
+        //{0x03, 0x65, 0xd4, 0x00, 0x00, 0x00}; //{0x0C, 0x60, 0x01, 0xFF, 0xFF};
+        toSend[1] = step; //custom;
+
+        address from = {0x08, 0x42, 0xe3}; //data->at(1).c_str(); //
+        address to_1 = {0x05, 0x4e, 0x17}; //{0x31, 0x58, 0x24}; //
+
+        if (!forgePacket(packet, toSend)) return false;
+
+        packet->payload.packet.header.cmd = 0x00; //SEND_WRITE_PRIVATE_0x20;
+        memorizeOther2W.memorizedData = toSend;
+        memorizeOther2W.memorizedCmd = 0x00; //SEND_WRITE_PRIVATE_0x20;
+
+        packet->payload.packet.header.CtrlByte1.asStruct.StartFrame = 1;
+
+        packet->payload.packet.header.CtrlByte2.asStruct.LPM = 1;
+        packet->payload.packet.header.CtrlByte2.asStruct.Prio = 1;
+
+        memcpy(packet->payload.packet.header.source, from/*gateway*/, 3);
+        memcpy(packet->payload.packet.header.target, to_1, 3);
+
+        packet->delayed = 250; // Give enough time for the answer
+        return true;
     }
 
     void iohcOtherDevice2W::cmd(Other2WButton cmd, Tokens *data) {
@@ -79,24 +207,7 @@ namespace IOHC {
         // Emulates device button press
         switch (cmd) {
             case Other2WButton::discovery: {
-                int bec = 0;
-
-                std::vector<iohcPacket *> packets2send;
-                for (int j = 0; j < 255; j++) {
-                    auto *packet = new iohcPacket;
-                    packets2send.push_back(packet);
-
-                    std::string discovery = "d430477706ba11ad31"; //28"; //"2b578ebc37334d6e2f50a4dfa9";
-                    std::vector<uint8_t> toSend = {};
-                    packet->buffer_length = hexStringToBytes(
-                        discovery, packet/*[j]*/->payload.buffer);
-                    forgePacket(packet/*[j]*//*->payload.buffer[4]*/, toSend, bec);
-                    bec += 0x01;
-                    packet->repeatTime = 250; // Slow down discovery loop
-                }
-
-                digitalWrite(RX_LED, digitalRead(RX_LED) ^ 1);
-                _radioInstance->send(packets2send);
+                startScan(ScanKind::Discovery);
                 break;
             }
             case Other2WButton::getName: {
@@ -113,8 +224,9 @@ namespace IOHC {
                 // uint8_t target[3] = {0x08, 0x42, 0xE3};
                 // toSend[3] = custom;
 
-                auto *packet = new iohcPacket;
-                forgePacket(packet, toSend, 0);
+                auto packet = iohcPacketPool::acquire();
+                if (!packet) break;
+                if (!forgePacket(packet.get(), toSend, 0)) break;
                 packet->payload.packet.header.cmd = SEND_GET_NAME_0x50;
                 // memorizeSend.memorizedData = toSend;
                 // memorizeSend.memorizedCmd = SEND_WRITE_PRIVATE_0x20;
@@ -130,48 +242,11 @@ namespace IOHC {
 
                 digitalWrite(RX_LED, digitalRead(RX_LED) ^ 1);
                 // packet->delayed = 501;
-                _radioInstance->send(packet);
+                _radioInstance->send(std::move(packet));
                 break;
             }
             case Other2WButton::custom: {
-                std::vector<uint8_t> toSend = {0x01, 0x47, 0xc8, 0x00, 0x00, 0x00};
-                //{0x03, 0x65, 0xd4, 0x00, 0x00, 0x00}; //{0x0C, 0x60, 0x01, 0xFF, 0xFF};
-                //const char* dat = data->at(1).c_str();
-                std::vector<iohcPacket *> packets2send;
-                for (int acei = 0; acei < 256; acei++) {
-                    //               int custom = std::stoi(data->at(1));
-                    AceiUnion ACEI{};
-                    ACEI.asByte = acei;
-                    // Only other ACEI are valids, other give answer: 0xFE 0x58
-                    if (!ACEI.asStruct.isvalid || ACEI.asStruct.service != 0) continue;
-
-                    toSend[1] = acei; //custom;
-                    // toSend[2] = acei;
-
-                    address from = {0x08, 0x42, 0xe3}; //data->at(1).c_str(); //
-                    address to = {0xda, 0x2e, 0xe6}; //
-                    address to_1 = {0x05, 0x4e, 0x17}; //{0x31, 0x58, 0x24}; //
-
-                    auto *packet = new iohcPacket;
-                    packets2send.push_back(packet);
-                    forgePacket(packet, toSend);
-
-                    packet->payload.packet.header.cmd = 0x00; //SEND_WRITE_PRIVATE_0x20;
-                    memorizeOther2W.memorizedData = toSend;
-                    memorizeOther2W.memorizedCmd = 0x00; //SEND_WRITE_PRIVATE_0x20;
-
-                    packet->payload.packet.header.CtrlByte1.asStruct.StartFrame = 1;
-
-                    packet->payload.packet.header.CtrlByte2.asStruct.LPM = 1;
-                    packet->payload.packet.header.CtrlByte2.asStruct.Prio = 1;
-
-                    memcpy(packet->payload.packet.header.source, from/*gateway*/, 3);
-                    memcpy(packet->payload.packet.header.target, to_1, 3);
-
-                    packet->delayed = 250; // Give enough time for the answer
-                }
-                digitalWrite(RX_LED, digitalRead(RX_LED) ^ 1);
-                _radioInstance->send(packets2send);
+                startScan(ScanKind::Custom);
                 break;
             }
             case Other2WButton::custom60: {
@@ -184,8 +259,9 @@ namespace IOHC {
 
                 toSend[3] = custom; //custom;
 
-                auto *packet = new iohcPacket;
-                forgePacket(packet, toSend);
+                auto packet = iohcPacketPool::acquire();
+                if (!packet) break;
+                if (!forgePacket(packet.get(), toSend)) break;
 
                 packet->payload.packet.header.cmd = iohcDevice::SEND_WRITE_PRIVATE_0x20;
                 memorizeOther2W.memorizedData = toSend;
@@ -201,7 +277,7 @@ namespace IOHC {
 
                 packet->delayed = 250;
                 digitalWrite(RX_LED, digitalRead(RX_LED) ^ 1);
-                _radioInstance->send(packet);
+                _radioInstance->send(std::move(packet));
                 break;
             }
             case Other2WButton::discover28: {
@@ -211,11 +287,15 @@ namespace IOHC {
                 address broadcast = {0x00, 0xFF, 0xFB}; //{0x02, 0x02, 0xFB}; //data->at(1).c_str();
                 //            hexStringToBytes(dat, broadcast);
                 size_t i = 0;
-                std::vector<iohcPacket *> packets2send;
+                std::vector<iohcPacketHandle> packets2send;
                 for (i = 0; i < 10; i++) {
-                    auto *packet = new iohcPacket;
-                    packets2send.push_back(packet);
-                    forgePacket(packet, toSend);
+                    packets2send.push_back(iohcPacketPool::acquire());
+                    auto *packet = packets2send.back().get();
+                    if (!packet) break;
+                    if (!forgePacket(packet, toSend)) {
+                        packets2send.pop_back();
+                        break;
+                    }
 
                     packet->payload.packet.header.cmd = iohcDevice::SEND_DISCOVER_0x28;
                     memorizeOther2W.memorizedData = toSend;
@@ -233,7 +313,7 @@ namespace IOHC {
                     packet->delayed = 250; // Give enough time for the answer
                 }
                 digitalWrite(RX_LED, digitalRead(RX_LED) ^ 1);
-                _radioInstance->send(packets2send);
+                _radioInstance->send(packets2send, TxPriority::Background);
                 break;
             }
             case Other2WButton::discover2A: {
@@ -255,20 +335,27 @@ namespace IOHC {
                 address broadcast_3b = {0x00, 0x00, 0x3b};
                 address broadcast_3f = {0x00, 0x00, 0x3f};
 
-                std::vector<iohcPacket *> packets2send;
+                std::vector<iohcPacketHandle> packets2send;
                 for (size_t i = 0; i < 2; i++) {
-                    auto *packet = new iohcPacket;
-                    packets2send.push_back(packet);
+                    packets2send.push_back(iohcPacketPool::acquire());
+                    auto *packet = packets2send.back().get();
+                    if (!packet) break;
 
                     if (i > 20) {
                         std::vector<uint8_t> toSend = {0x00};
-                        forgePacket(packet, toSend);
+                        if (!forgePacket(packet, toSend)) {
+                            packets2send.pop_back();
+                            break;
+                        }
                         packet->payload.packet.header.cmd = iohcDevice::SEND_UNKNOWN_0x2E;
                         memcpy(packet->payload.packet.header.target, broadcast_3f, 3);
                     }
                     if (i <= 20) {
                         std::vector<uint8_t> toSend = {};
-                        forgePacket(packet, toSend);
+                        if (!forgePacket(packet, toSend)) {
+                            packets2send.pop_back();
+                            break;
+                        }
                         packet->payload.packet.header.cmd = iohcDevice::SEND_DISCOVER_0x28;
                         memcpy(packet->payload.packet.header.target, broadcast_3b, 3);
                     }
@@ -279,7 +366,10 @@ namespace IOHC {
                         std::vector<uint8_t> toSend2 = {
                             0xa0, 0xb4, 0x38, 0xd2, 0x5f, 0x27, 0x28, 0x6f, 0xed, 0xd2, 0xad, 0x1f
                         };
-                        forgePacket(packet, toSend2);
+                        if (!forgePacket(packet, toSend2)) {
+                            packets2send.pop_back();
+                            break;
+                        }
                         packet->payload.packet.header.cmd = iohcDevice::SEND_DISCOVER_REMOTE_0x2A;
                         memcpy(packet->payload.packet.header.target, broadcast_3b, 3);
                     }
@@ -301,7 +391,7 @@ namespace IOHC {
                 }
                 digitalWrite(RX_LED, digitalRead(RX_LED) ^ 1);
 
-                _radioInstance->send(packets2send);
+                _radioInstance->send(packets2send, TxPriority::Background);
 
                 break;
             }
@@ -324,11 +414,15 @@ namespace IOHC {
                 };
 
                 size_t i = 0;
-                std::vector<iohcPacket *> packets2send;
+                std::vector<iohcPacketHandle> packets2send;
                 for (i = 0; i < 15; i++) {
-                    auto *packet = new iohcPacket;
-                    packets2send.push_back(packet);
-                    forgePacket(packet, toSend);
+                    packets2send.push_back(iohcPacketPool::acquire());
+                    auto *packet = packets2send.back().get();
+                    if (!packet) break;
+                    if (!forgePacket(packet, toSend)) {
+                        packets2send.pop_back();
+                        break;
+                    }
 
                     packet->payload.packet.header.cmd = 0x00;
                     memorizeOther2W.memorizedData = toSend;
@@ -347,15 +441,16 @@ namespace IOHC {
                     packet->repeatTime = 250; // Slow down discover loop
                 }
                 digitalWrite(RX_LED, digitalRead(RX_LED) ^ 1);
-                _radioInstance->send(packets2send);
+                _radioInstance->send(packets2send, TxPriority::Background);
 
                 break;
             }
             case Other2WButton::ack: {
                 std::vector<uint8_t> toSend = {};
 
-                auto *packet = new iohcPacket;
-                forgePacket(packet, toSend);
+                auto packet = iohcPacketPool::acquire();
+                if (!packet) break;
+                if (!forgePacket(packet.get(), toSend)) break;
 
                 packet->payload.packet.header.cmd = iohcDevice::SEND_KEY_TRANSFERT_ACK_0x33;
                 memorizeOther2W.memorizedCmd = iohcDevice::SEND_KEY_TRANSFERT_ACK_0x33;
@@ -367,97 +462,17 @@ namespace IOHC {
                 memcpy(packet->payload.packet.header.target, master_from, 3);
 
                 digitalWrite(RX_LED, digitalRead(RX_LED) ^ 1);
-                _radioInstance->send(packet);
+                _radioInstance->send(std::move(packet));
                 break;
             }
             case Other2WButton::checkCmd: {
-                std::vector<uint8_t> toSend;
-                // = {}; //{0x01, 0x02, 0x03, 0x04, 0x05, 0x06}; //, 0x07, 0x08, 0x09, 0x10, 0x11, 0x12};
-                uint8_t special12[] = {
-                    0x01, 0x02, 0x03, 0x04, 0x05, 0x06, 0x07, 0x08, 0x09, 0x10, 0x11, 0x12, 0x13, 0x14, 0x15, 0x16,
-                    0x17, 0x18, 0x19, 0x20, 0x21
-                };
-                uint8_t specacei[] = {0x01, 0xe7, 0x00, 0x00, 0x00, 0x00};
-                // address broadcast;
-                // const char* dat = data->at(1).c_str();
-                // hexStringToBytes(dat, broadcast);
-
-                address from = {0x08, 0x42, 0xe3}; //data->at(1).c_str(); //
-                address to_0 = {0xda, 0x2e, 0xe6}; //
-                address to_1 = {0x05, 0x4e, 0x17}; //{0x31, 0x58, 0x24}; //
-                address to_2 = {0x9a, 0x50, 0x65};
-                address to_3 = {0x31, 0x58, 0x24};
-                //{0x47, 0x77, 0x06}, {0x48, 0x79, 0x02}, {0x8C, 0xCB, 0x30}, {0x8C, 0xCB, 0x31}
-                address broad = {0x00, 0x0d, 0x3b}; //{0x00, 0xFF, 0xFB}; //
-
-                uint8_t counter = 0;
-                std::vector<iohcPacket *> packets2send;
-                for (const auto &command: mapValid) {
-                    if (command.second == 0 || (command.second == 5 && command.first != 0x19)) {
-                        counter++;
-
-                        // 0x00,  0x01, 0x03, 0x0a, 0x0c, 0x19, 0x1e, 0x20, 0x23, 0x28, 0x2a(12), 0x2c, 0x2e, 0x31, 0x32(16), 0x36, 0x38(6), 0x39, 0x3c(6), 0x46(9), 0x48(9), 0x4a(18), 0x4b
-                        // ,0x50, 0x52(16), 0x54, 0x56, 0x60(21), 0x64(2), 0x6e(9), 0x6f(9), 0x71, 0x73(3), 0x80, 0x82(21), 0x84, 0x86, 0x88, 0x8a(18), 0x8b(1), 0x8e, 0x90, 0x92(16), 0x94, 0x96(12), 0x98
-
-                        if (command.first == 0x00 || command.first == 0x01 || command.first == 0x0B || command.first ==
-                            0x0E || command.first == 0x23 || command.first == 0x2A || command.first == 0x1E)
-                            toSend.assign(specacei, specacei + 6);
-                        if (command.first == 0x8B || command.first == 0x19)
-                            toSend.assign(special12, special12 + 1);
-                        if (command.first == 0x04) toSend.assign(special12, special12 + 14);
-                        uint8_t special03[] = {0x03, 0x00, 0x00};
-                        if (command.first == 0x03 || command.first == 0x73)
-                            toSend.assign(special03, special03 + 3);
-                        uint8_t special0C[] = {0xD8, 0x00, 0x00, 0x00};
-                        if (command.first == 0x0C)
-                            toSend.assign(special0C, special0C + 4);
-                        uint8_t special0D[] = {0x05, 0xaa, 0x0d, 0x00, 0x00};
-                        if (command.first == 0x0D)
-                            toSend.assign(special0D, special0D + 5);
-                        if (command.first == 0x64 || command.first == 0x14)
-                            toSend.assign(special12, special12 + 2);
-                        if (command.first == 0x2A || command.first == 0x96)
-                            toSend.assign(special12, special12 + 12);
-                        if (command.first == 0x38 || command.first == 0x3C || command.first == 0x3D)
-                            toSend.assign(special12, special12 + 6);
-                        if (command.first == 0x32 || command.first == 0x52 || command.first == 0x92)
-                            toSend.assign(special12, special12 + 16);
-                        if (command.first == 0x46 || command.first == 0x48 || command.first == 0x6E || command.first == 0x6F)
-                            toSend.assign(special12, special12 + 9);
-                        if (command.first == 0x4A || command.first == 0x8A)
-                            toSend.assign(special12, special12 + 18);
-                        if (command.first == 0x60 || command.first == 0x82)
-                            toSend.assign(special12, special12 + 21);
-
-                        auto *packet = new iohcPacket;
-                        packets2send.push_back(packet);
-                        forgePacket(packet, toSend);
-                        packet->payload.packet.header.cmd = command.first;
-                        memorizeOther2W.memorizedCmd = packet->payload.packet.header.cmd;
-
-                        packet->payload.packet.header.CtrlByte1.asStruct.StartFrame = 1;
-                        packet->payload.packet.header.CtrlByte1.asStruct.EndFrame = 0;
-                        packet->payload.packet.header.CtrlByte2.asStruct.LPM = 1;
-                        packet->payload.packet.header.CtrlByte2.asStruct.Prio = 1;
-
-                        memcpy(packet->payload.packet.header.source, gateway/*from*//*gateway*/, 3);
-                        // if (command.first == 0x14 || command.first == 0x19 || command.first == 0x1e || command.first == 0x2a || command.first == 0x34 || command.first == 0x4a) {
-                        // memcpy(packet->payload.packet.header.target, broad, 3);
-                        // } else {
-                        memcpy(packet->payload.packet.header.target, master_to, 3);
-                        // }
-
-                        //packet->delayed = 245;
-                        packet->repeatTime = 250; // Slow down discover loop
-                        packet->delayed = 250;   // Give enough time for the answer
-                    }
-                    toSend.clear();
-                }
-                Serial.printf("valid %u\n", counter);
-                digitalWrite(RX_LED, digitalRead(RX_LED) ^ 1);
-
-                _radioInstance->send(packets2send);
-
+                // Commands not answered yet, or refused with 0x05 (0x19 excepted), streamed by chunks
+                scanCmds.clear();
+                for (const auto &command: mapValid)
+                    if (command.second == 0 || (command.second == 5 && command.first != 0x19))
+                        scanCmds.push_back(command.first);
+                Serial.printf("valid %u\n", static_cast<unsigned>(scanCmds.size()));
+                startScan(ScanKind::Check);
                 break;
             }
             default: break;
@@ -0,0 +1,82 @@
+/*
+   Copyright (c) 2024. CRIDP https://github.com/cridp
+
+   Licensed under the Apache License, Version 2.0 (the "License");
+   you may not use this file except in compliance with the License.
+   You may obtain a copy of the License at
+
+           http://www.apache.org/licenses/LICENSE-2.0
+
+   Unless required by applicable law or agreed to in writing, software
+   distributed under the License is distributed on an "AS IS" BASIS,
+   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+   See the License for the specific language governing permissions and
+   limitations under the License.
+ */
+
+#include <Arduino.h>
+#include <iohcPacket.h>
+#include <iohcFormatter.h>
+#include <iohcFrameLayout.h>
+#include <cstdio>
+#include <cstring>
+#include <esp_timer.h>
+#include <utils.h>
+#include <sstream>
+#include <iomanip>
+
+// Bench of the log line formatters, keeps the ostringstream reference out of the frame decoding path
+namespace IOHC {
+    namespace {
+        // The log line as it was built before iohcFormatter, kept as the reference of benchFormat
+        std::string legacySummary(const iohcPacket &packet, char dir) {
+            const auto &header = packet.payload.packet.header;
+            std::ostringstream ss;
+            ss << "(" << std::setw(2) << std::setfill('0') << std::dec << (int)header.CtrlByte1.asStruct.MsgLen << ") ";
+            ss << (header.CtrlByte1.asStruct.Protocol ? "1W" : "2W") << " ";
+            ss << "FROM " << std::uppercase << std::hex << std::setw(2) << std::setfill('0')
+               << (int)header.source[0] << (int)header.source[1] << (int)header.source[2]
+               << " TO " << (int)header.target[0] << (int)header.target[1] << (int)header.target[2]
+               << " CMD " << (int)header.cmd;
+            uint8_t dataLen = packet.buffer_length - IOHC_HEADER_LEN;
+            ss << " DATA(" << std::dec << (int)dataLen << ") ";
+            if (dataLen) ss << bitrow_to_hex_string(packet.payload.buffer + IOHC_HEADER_LEN, dataLen);
+            ss << " " << dir;
+            return ss.str();
+        }
+    }
+
+/**
+ * The `benchFormat` function times the log line of a 1W frame built with ostringstream and wrapped in a
+ * String, as the radio used to for every frame, against `summarize` and `format` into a stack buffer.
+ */
+    void iohcPacket::benchFormat(uint16_t rounds) {
+        iohcPacket packet;
+        const uint8_t frame[] = {0xf8, 0x00, 0x00, 0x00, 0x3f, 0x12, 0x34, 0x56, 0x00,
+                                 0x01, 0xe7, 0x00, 0x00, 0x00, 0x00, 0x12, 0x34, 0x56, 0x78, 0x9a, 0xbc, 0xde, 0xf0, 0x11, 0x22};
+        memcpy(packet.payload.buffer, frame, sizeof(frame));
+        packet.buffer_length = sizeof(frame);
+        volatile size_t sink = 0; // Keeps the loops from being optimized out
+
+        int64_t start = esp_timer_get_time();
+        for (uint16_t i = 0; i < rounds; i++) {
+            String line(legacySummary(packet, packet.summaryDirection()).c_str());
+            sink = sink + line.length();
+        }
+        const int64_t legacy = esp_timer_get_time() - start;
+
+        char line[IOHC_DECODE_LINE_LEN];
+        start = esp_timer_get_time();
+        for (uint16_t i = 0; i < rounds; i++) sink = sink + packet.summarize(line, IOHC_SUMMARY_LEN);
+        const int64_t summary = esp_timer_get_time() - start;
+
+        start = esp_timer_get_time();
+        for (uint16_t i = 0; i < rounds; i++) sink = sink + packet.format(line, sizeof(line), true);
+        const int64_t decode = esp_timer_get_time() - start;
+
+        printf("Format bench, %u frames:\n", rounds);
+        printf("  ostringstream + String log line: %u ns/frame\n", static_cast<unsigned>(legacy * 1000 / rounds));
+        printf("  summarize log line:              %u ns/frame\n", static_cast<unsigned>(summary * 1000 / rounds));
+        printf("  format decode line:              %u ns/frame\n", static_cast<unsigned>(decode * 1000 / rounds));
+    }
+}
@@ -0,0 +1,108 @@
+/*
+   Copyright (c) 2024. CRIDP https://github.com/cridp
+
+   Licensed under the Apache License, Version 2.0 (the "License");
+   you may not use this file except in compliance with the License.
+   You may obtain a copy of the License at
+
+           http://www.apache.org/licenses/LICENSE-2.0
+
+   Unless required by applicable law or agreed to in writing, software
+   distributed under the License is distributed on an "AS IS" BASIS,
+   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+   See the License for the specific language governing permissions and
+   limitations under the License.
+ */
+
+#include <cstdio>
+
+#include <iohcPacketPool.h>
+
+namespace IOHC {
+    static_assert(IOHC_OUTBOUND_MAX_PACKETS <= 256, "iohcPacketPool indexes its slots with a byte");
+    static_assert(IOHC_POOL_REPLY_RESERVE < IOHC_OUTBOUND_MAX_PACKETS, "The reply reserve must leave slots for other sends");
+
+    iohcPacket iohcPacketPool::slots[IOHC_OUTBOUND_MAX_PACKETS]{};
+    bool iohcPacketPool::inUse[IOHC_OUTBOUND_MAX_PACKETS]{};
+    uint8_t iohcPacketPool::freeSlots[IOHC_OUTBOUND_MAX_PACKETS]{};
+    size_t iohcPacketPool::freeCount = 0;
+    size_t iohcPacketPool::neverUsed = IOHC_OUTBOUND_MAX_PACKETS;
+    size_t iohcPacketPool::lowWater = IOHC_OUTBOUND_MAX_PACKETS;
+    uint32_t iohcPacketPool::exhausted = 0;
+    uint32_t iohcPacketPool::reserveRefused = 0;
+    uint32_t iohcPacketPool::invalidReleases = 0;
+    portMUX_TYPE iohcPacketPool::mux = portMUX_INITIALIZER_UNLOCKED;
+
+/**
+ * The `acquire` function takes a packet out of the pool, reset to its defaults.
+ *
+ * @param reply True for a protocol reply, which may dip into the last IOHC_POOL_REPLY_RESERVE slots.
+ * @return A handle owning the packet, empty when all IOHC_OUTBOUND_MAX_PACKETS are in use, or when only
+ *         the reply reserve is left and `reply` is false.
+ */
+    iohcPacketPool::Handle iohcPacketPool::acquire(bool reply) {
+        uint8_t idx;
+        portENTER_CRITICAL(&mux);
+        if (!reply && freeCount + neverUsed <= IOHC_POOL_REPLY_RESERVE) {
+            reserveRefused++;
+            portEXIT_CRITICAL(&mux);
+            return Handle{};
+        }
+        // Reuse the most recently released slot first, then the ones never handed out
+        if (freeCount) {
+            idx = freeSlots[--freeCount];
+        } else if (neverUsed) {
+            idx = static_cast<uint8_t>(IOHC_OUTBOUND_MAX_PACKETS - neverUsed--);
+        } else {
+            exhausted++;
+            portEXIT_CRITICAL(&mux);
+            printf("TX: packet pool exhausted (%u in use)\n", static_cast<unsigned>(IOHC_OUTBOUND_MAX_PACKETS));
+            return Handle{};
+        }
+        inUse[idx] = true;
+        if (freeCount + neverUsed < lowWater) lowWater = freeCount + neverUsed;
+        portEXIT_CRITICAL(&mux);
+
+        slots[idx] = iohcPacket{};
+        return Handle{&slots[idx]};
+    }
+
+/**
+ * The `release` function gives a packet back to the pool. Pointers not coming from the pool and
+ * double releases are refused and counted.
+ */
+    void iohcPacketPool::release(iohcPacket *packet) {
+        if (!packet) return;
+        const ptrdiff_t idx = packet - slots;
+        portENTER_CRITICAL(&mux);
+        if (idx < 0 || idx >= static_cast<ptrdiff_t>(IOHC_OUTBOUND_MAX_PACKETS) || !inUse[idx]) {
+            invalidReleases++;
+            portEXIT_CRITICAL(&mux);
+            return;
+        }
+        inUse[idx] = false;
+        freeSlots[freeCount++] = static_cast<uint8_t>(idx);
+        portEXIT_CRITICAL(&mux);
+    }
+
+    size_t iohcPacketPool::available() {
+        portENTER_CRITICAL(&mux);
+        const size_t count = freeCount + neverUsed;
+        portEXIT_CRITICAL(&mux);
+        return count;
+    }
+
+    void iohcPacketPool::dump() {
+        portENTER_CRITICAL(&mux);
+        const size_t count = freeCount + neverUsed;
+        const size_t low = lowWater;
+        const uint32_t refused = exhausted;
+        const uint32_t reserved = reserveRefused;
+        const uint32_t invalid = invalidReleases;
+        portEXIT_CRITICAL(&mux);
+        printf("TX pool: %u/%u free, low water %u, %u refused (exhausted), %u refused (reply reserve), %u invalid releases\n",
+               static_cast<unsigned>(count), static_cast<unsigned>(IOHC_OUTBOUND_MAX_PACKETS),
+               static_cast<unsigned>(low), static_cast<unsigned>(refused), static_cast<unsigned>(reserved),
+               static_cast<unsigned>(invalid));
+    }
+}
@@ -19,43 +19,72 @@
 #include "esp_log.h"
 
 #include <iohcRadio.h>
+#include <iohcTrace.h>
+#include <iohcFormatter.h>
 #include <utility>
 #include <log_buffer.h>
 #define LONG_PREAMBLE_MS 1920
 #define SHORT_PREAMBLE_MS 40
+// Events notified to the radio task
+#define RX_NOTIFY_PAYLOAD   0x01    // DIO0: PayloadReady, or PacketSent in TX
+#define RX_NOTIFY_PREAMBLE  0x02    // Preamble detected
+#define RX_NOTIFY_TX_SENT   0x04    // PacketSent of the TX engine, in addition to RX_NOTIFY_PAYLOAD
+#define RX_NOTIFY_DEADLINE  0x08    // RX timer expired
 
 namespace IOHC {
     iohcRadio *iohcRadio::_iohcRadio = nullptr;
-    volatile unsigned long iohcRadio::_g_payload_millis = 0L;
+    volatile unsigned long iohcRadio::irqStamp = 0L;
     uint8_t iohcRadio::_flags[2] = {0, 0};
     volatile bool iohcRadio::send_lock = false;
     volatile iohcRadio::RadioState iohcRadio::radioState = iohcRadio::RadioState::IDLE;
     volatile bool iohcRadio::txComplete = false;
+    volatile bool iohcRadio::frequencyLocked = false;
 
 
     TaskHandle_t handle_interrupt;
     /**
-     * The function `handle_interrupt_task` waits for a notification and then calls the `tickerCounter`
-     * function if certain conditions are met.
+     * The function `handle_interrupt_task` waits for the events notified by the interrupt handler and the
+     * RX timer, and runs them through the RX state machine.
      *
      * @param pvParameters The `pvParameters` parameter in the `handle_interrupt_task` function is a void
      * pointer that can be used to pass any data or object to the task when it is created. In this specific
      * function, it is being cast to a pointer of type `iohcRadio` and then passed to the
      */
     void IRAM_ATTR handle_interrupt_task(void *pvParameters) {
-        static uint32_t thread_notification;
+        auto *radio = (iohcRadio *) pvParameters;
         const TickType_t xMaxBlockTime = pdMS_TO_TICKS(655 * 4); // 218.4 );
         while (true) {
-            thread_notification = ulTaskNotifyTake(pdTRUE, xMaxBlockTime/*xNoDelay*/); // Attendre la notification
-            if (thread_notification &&
-                (iohcRadio::radioState == iohcRadio::RadioState::PAYLOAD ||
-                 iohcRadio::radioState == iohcRadio::RadioState::PREAMBLE)) {
-                iohcRadio::tickerCounter((iohcRadio *) pvParameters);
-            }
+            uint32_t events = 0;
+            xTaskNotifyWait(0, ULONG_MAX, &events, xMaxBlockTime); // Attendre la notification
+            radio->checkLockTimeout();
+#if defined(RADIO_SX127X)
+            if (events & RX_NOTIFY_PREAMBLE) radio->rxEvent(iohcRadio::RxEvent::Preamble);
+            if (events & RX_NOTIFY_PAYLOAD) radio->rxEvent(iohcRadio::RxEvent::Payload);
+            // After the Payload event took the state out of TX, as onPacketSent expects
+            if (events & RX_NOTIFY_TX_SENT) radio->onPacketSent();
+            if (events & RX_NOTIFY_DEADLINE) radio->rxEvent(iohcRadio::RxEvent::Deadline);
+#elif defined(CC1101)
+            if (events) iohcRadio::tickerCounter(radio);
+#endif
         }
 
     }
 
+    TaskHandle_t handle_dispatch;
+    /**
+     * The function `handle_dispatch_task` waits for the radio task to publish received frames and hands
+     * them to the consumers (callback, decode, log), so that work never delays the next interrupt or hop.
+     *
+     * @param pvParameters Pointer to the `iohcRadio` instance owning the RX ring.
+     */
+    void handle_dispatch_task(void *pvParameters) {
+        auto *radio = (iohcRadio *) pvParameters;
+        while (true) {
+            ulTaskNotifyTake(pdTRUE, portMAX_DELAY);
+            radio->dispatchReceived();
+        }
+    }
+
     /**
      * The function `handle_interrupt_fromisr` reads digital inputs and notifies a thread to wake up when
      * the interrupt service routine is complete.
@@ -64,41 +93,42 @@ namespace IOHC {
         bool preamble = digitalRead(RADIO_PREAMBLE_DETECTED);
         bool payload = digitalRead(RADIO_PACKET_AVAIL);
         iohcRadio::txComplete = true;
-        ets_printf("TX: TX-RX DONE detected, flag set\n");
-
+        iohcTrace::record(TraceEvent::Irq, preamble, payload);
 
+        // The state changes are left to the RX state machine, see rxTransition()
+        uint32_t events = 0;
         if (payload) {
-            // When in TX state DIO0 is mapped to PacketSent, otherwise it
-            // signals PayloadReady. Use the current radio state to disambiguate
-            // without touching SPI from the ISR.
-            //if (iohcRadio::radioState == iohcRadio::RadioState::TX) {
-            //    iohcRadio::txComplete = true;
-            //    ets_printf("TX: TXDONE detected, flag set\n");
-            //    iohcRadio::setRadioState(iohcRadio::RadioState::RX);
-            //} else {
-                iohcRadio::setRadioState(iohcRadio::RadioState::PAYLOAD);
-            //}
+            iohcRadio::irqStamp = esp_timer_get_time();
+            events = RX_NOTIFY_PAYLOAD;
+            // DIO0 is PacketSent while transmitting
+            if (iohcRadio::radioState == iohcRadio::RadioState::TX) events |= RX_NOTIFY_TX_SENT;
         } else if (preamble) {
-            iohcRadio::setRadioState(iohcRadio::RadioState::PREAMBLE);
-        } else {
-            iohcRadio::setRadioState(iohcRadio::RadioState::RX);
+            events = RX_NOTIFY_PREAMBLE;
         }
+        if (!events) return; // Edge already gone, the RX timer deadline recovers the state
 
         // Notify de RX state machine
         BaseType_t xHigherPriorityTaskWoken = pdFALSE;
-        vTaskNotifyGiveFromISR(handle_interrupt, &xHigherPriorityTaskWoken);
+        xTaskNotifyFromISR(handle_interrupt, events, eSetBits, &xHigherPriorityTaskWoken);
         portYIELD_FROM_ISR(xHigherPriorityTaskWoken);
     }
 
 
 
     iohcRadio::iohcRadio() {
+        txMutex = xSemaphoreCreateRecursiveMutex();
+        const esp_timer_create_args_t txTimerArgs = {&iohcRadio::onTxTimer, this, ESP_TIMER_TASK, "txGap"};
+        esp_timer_create(&txTimerArgs, &txTimer);
+        const esp_timer_create_args_t rxTimerArgs = {&iohcRadio::onRxTimer, this, ESP_TIMER_TASK, "rxDeadline"};
+        esp_timer_create(&rxTimerArgs, &rxTimer);
+        const esp_timer_create_args_t lbtTimerArgs = {&iohcRadio::onLbtTimer, this, ESP_TIMER_TASK, "lbtSample"};
+        esp_timer_create(&lbtTimerArgs, &lbtTimer);
         Radio::initHardware();
         Radio::calibrate();
 
         Radio::initRegisters(MAX_FRAME_LEN);
         Radio::setCarrier(Radio::Carrier::Deviation, 19200);
-        Radio::setCarrier(Radio::Carrier::Bitrate, 38400);
+        Radio::setCarrier(Radio::Carrier::Bitrate, IOHC_BITRATE);
         Radio::setCarrier(Radio::Carrier::Bandwidth, 250);
         Radio::setCarrier(Radio::Carrier::Modulation, Radio::Modulation::FSK);
 
@@ -126,6 +156,14 @@ namespace IOHC {
             // sx127x_destroy(device);
             return;
         }
+
+        // Decoding and publishing run at a lower priority than the radio state machine
+        task_code = xTaskCreatePinnedToCore(handle_dispatch_task, "handle_dispatch_task", 8192,
+                                            this, 2, &handle_dispatch, tskNO_AFFINITY);
+        if (task_code != pdPASS) {
+            printf("ERROR DISPATCH Can't create task %d\n", task_code);
+            return;
+        }
     }
 
     /**
@@ -167,83 +205,206 @@ namespace IOHC {
         this->scanTimeUs = scanTimeUs ? scanTimeUs : DEFAULT_SCAN_INTERVAL_US;
         this->rxCB = std::move(rxCallback);
         this->txCB = std::move(txCallback);
+        hopPolicy.begin(num_freqs, this->scanTimeUs);
+        scanFrf.clear();
+        for (uint8_t idx = 0; idx < num_freqs; idx++) scanFrf.push_back(Radio::frfFor(scan_freqs[idx]));
+        dedup.begin();
 
         Radio::clearBuffer();
         Radio::clearFlags();
         /* We always start at freq[0] the 1W/2W channel*/
-        Radio::setCarrier(Radio::Carrier::Frequency, scan_freqs[0]); //868950000);
+        Radio::setFrequency(scanFrf[0]); //868950000);
         // Radio::calibrate();
         Radio::setRx();
+#if defined(RADIO_SX127X)
+        setRadioState(RadioState::RX);
+        armRxTimer(hopPolicy.dwellUs(currentFreqIdx));
+#endif
     }
 
 /**
- * The `tickerCounter` function in C++ handles various radio operations based on different conditions
- * and configurations for SX127X and CC1101 radios.
- * 
- * @param radio The `radio` parameter in the `iohcRadio::tickerCounter` function is a pointer to an
- * instance of the `iohcRadio` class. This pointer is used to access and modify the properties and
- * methods of the `iohcRadio` object within the function. The function uses this pointer
- * 
- * @return In the provided code snippet, the function `tickerCounter` is returning different values
- * based on the conditions met within the function. Here is a breakdown of the possible return
- * scenarios:
+ * The `rxTransition` function is the RX state machine: the next state, the actions and the deadline to
+ * arm for `event` in `state`. It has no side effect, `rxEvent` carries the step out.
+ *
+ * While listening the timer holds the hop deadline of the current channel, after a preamble the
+ * recovery timeout, so a preamble detect that never leads to a payload cannot hold the receiver.
+ * A 2W exchange or a TX batch not done yet holds the channel: no hop until released, so the packets
+ * of a batch sent on the scan frequency all go out on the same channel.
  */
-    void IRAM_ATTR iohcRadio::tickerCounter(iohcRadio *radio) {
-        // Not need to put in IRAM as we reuse task for µs instead ISR
-#if defined(RADIO_SX127X)
-        Radio::readBytes(REG_IRQFLAGS1, _flags, sizeof(_flags));
-
-        // If Int of PayLoad
-        if (radioState == iohcRadio::RadioState::PAYLOAD) {
-            // if TX ready?
-            if (_flags[0] & RF_IRQFLAGS1_TXREADY) {
-                Radio::clearFlags();
-                if (radioState != iohcRadio::RadioState::TX) {
-                    Radio::setRx();
-                    radio->setRadioState(iohcRadio::RadioState::RX);
+    constexpr iohcRadio::RxStep iohcRadio::rxTransition(RadioState state, RxEvent event, RxInputs in) {
+        // A 2W exchange or a TX batch not done yet keeps the receiver on its channel
+        const bool hold = in.locked || in.txBusy;
+        const RadioState listening = hold ? RadioState::LOCKED : RadioState::RX;
+        switch (event) {
+            case RxEvent::Preamble:
+                if (state == RadioState::RX || state == RadioState::LOCKED || state == RadioState::IDLE)
+                    return {RadioState::PREAMBLE, RX_COUNT_PREAMBLE, RxTimer::PreambleRecovery};
+                return {state, 0, RxTimer::None};
+            case RxEvent::Payload:
+                // In TX it is PacketSent: back to listening, on the TX channel while the batch is not
+                // done, the TX engine goes on from onPacketSent
+                if (state == RadioState::TX) return {listening, RX_LISTEN, RxTimer::Dwell};
+                return {listening, RX_RECEIVE, RxTimer::Dwell};
+            case RxEvent::Deadline:
+                switch (state) {
+                    case RadioState::PREAMBLE:
+                        if (in.preambleActive) return {state, 0, RxTimer::PreambleRecovery};
+                        return {listening, RX_CLEAR_FLAGS, RxTimer::Dwell};
+                    case RadioState::RX:
+                        if (hold) return {RadioState::LOCKED, 0, RxTimer::Dwell};
+                        return {state, RX_HOP, RxTimer::Dwell};
+                    case RadioState::LOCKED:
+                        if (!hold) return {RadioState::RX, 0, RxTimer::Dwell};
+                        return {state, 0, RxTimer::Dwell};
+                    case RadioState::TX:
+                        return {state, 0, RxTimer::Dwell};
+                    default:
+                        return {listening, RX_CLEAR_FLAGS, RxTimer::Dwell};
                 }
-                // radio->sent(radio->packets2send[radio->txCounter]); // Put after Workaround to permit MQTT sending. No more needed
+            default:
+                break;
+        }
+        return {state, 0, RxTimer::None};
+    }
+
+    namespace {
+        using RxState = iohcRadio::RadioState;
+        using RxEvent = iohcRadio::RxEvent;
+        using RxTimer = iohcRadio::RxTimer;
+        constexpr bool rxStepIs(iohcRadio::RxStep step, RxState next, uint8_t actions, RxTimer arm) {
+            return step.next == next && step.actions == actions && step.arm == arm;
+        }
+        constexpr iohcRadio::RxInputs RX_FREE{false, false, false};
+        constexpr iohcRadio::RxInputs RX_LOCKED{true, false, false};
+        constexpr iohcRadio::RxInputs RX_PREAMBLE_ON{false, true, false};
+        constexpr iohcRadio::RxInputs RX_TX_BUSY{false, false, true};
+    }
+    static_assert(rxStepIs(iohcRadio::rxTransition(RxState::RX, RxEvent::Deadline, RX_FREE),
+                           RxState::RX, iohcRadio::RX_HOP, RxTimer::Dwell), "Dwell expired: hop");
+    static_assert(rxStepIs(iohcRadio::rxTransition(RxState::RX, RxEvent::Deadline, RX_LOCKED),
+                           RxState::LOCKED, 0, RxTimer::Dwell), "Locked channel: no hop");
+    static_assert(rxStepIs(iohcRadio::rxTransition(RxState::LOCKED, RxEvent::Deadline, RX_LOCKED),
+                           RxState::LOCKED, 0, RxTimer::Dwell), "Locked channel: no hop");
+    static_assert(rxStepIs(iohcRadio::rxTransition(RxState::LOCKED, RxEvent::Deadline, RX_FREE),
+                           RxState::RX, 0, RxTimer::Dwell), "Nothing holds the channel: scan again");
+    static_assert(rxStepIs(iohcRadio::rxTransition(RxState::TX, RxEvent::Deadline, RX_FREE),
+                           RxState::TX, 0, RxTimer::Dwell), "No hop on air");
+    static_assert(rxStepIs(iohcRadio::rxTransition(RxState::RX, RxEvent::Deadline, RX_TX_BUSY),
+                           RxState::LOCKED, 0, RxTimer::Dwell), "Batch not done: no hop");
+    static_assert(rxStepIs(iohcRadio::rxTransition(RxState::TX, RxEvent::Payload, RX_TX_BUSY),
+                           RxState::LOCKED, iohcRadio::RX_LISTEN, RxTimer::Dwell),
+                  "PacketSent mid-batch: listen on the TX channel, no hop");
+    static_assert(rxStepIs(iohcRadio::rxTransition(RxState::LOCKED, RxEvent::Payload, RX_TX_BUSY),
+                           RxState::LOCKED, iohcRadio::RX_RECEIVE, RxTimer::Dwell),
+                  "Answer mid-batch: stay on the TX channel");
+    static_assert(rxStepIs(iohcRadio::rxTransition(RxState::RX, RxEvent::Preamble, RX_FREE),
+                           RxState::PREAMBLE, iohcRadio::RX_COUNT_PREAMBLE, RxTimer::PreambleRecovery),
+                  "Preamble: stop hopping, arm recovery");
+    static_assert(rxStepIs(iohcRadio::rxTransition(RxState::PREAMBLE, RxEvent::Preamble, RX_FREE),
+                           RxState::PREAMBLE, 0, RxTimer::None), "Preamble counted once");
+    static_assert(rxStepIs(iohcRadio::rxTransition(RxState::PREAMBLE, RxEvent::Deadline, RX_PREAMBLE_ON),
+                           RxState::PREAMBLE, 0, RxTimer::PreambleRecovery), "Preamble still on: wait");
+    static_assert(rxStepIs(iohcRadio::rxTransition(RxState::PREAMBLE, RxEvent::Deadline, RX_LOCKED),
+                           RxState::LOCKED, iohcRadio::RX_CLEAR_FLAGS, RxTimer::Dwell), "Preamble recovery");
+    static_assert(rxStepIs(iohcRadio::rxTransition(RxState::PREAMBLE, RxEvent::Payload, RX_FREE),
+                           RxState::RX, iohcRadio::RX_RECEIVE, RxTimer::Dwell), "Payload: receive, new dwell");
+    static_assert(rxStepIs(iohcRadio::rxTransition(RxState::TX, RxEvent::Payload, RX_LOCKED),
+                           RxState::LOCKED, iohcRadio::RX_LISTEN, RxTimer::Dwell), "PacketSent: listen");
+    static_assert(rxStepIs(iohcRadio::rxTransition(RxState::TX, RxEvent::Preamble, RX_FREE),
+                           RxState::TX, 0, RxTimer::None), "No preamble on air");
+    static_assert(rxStepIs(iohcRadio::rxTransition(RxState::ERROR, RxEvent::Deadline, RX_FREE),
+                           RxState::RX, iohcRadio::RX_CLEAR_FLAGS, RxTimer::Dwell), "Recover from error");
+
+/**
+ * The `rxEvent` function runs an event through `rxTransition` in the radio task and carries out the
+ * step: read the frame or listen again, hop, then arm the RX timer for the next deadline. It holds
+ * `txMutex` throughout, so the TX engine cannot take the radio between the state read and the
+ * register accesses.
+ */
+    void iohcRadio::rxEvent(RxEvent event) {
+        xSemaphoreTakeRecursive(txMutex, portMAX_DELAY);
+        const RadioState state = radioState;
+        const int64_t now = esp_timer_get_time();
+        if (event == RxEvent::Deadline) {
+            // Notified before the timer was armed again
+            if (now < rxDeadlineUs) {
+                rxStats.staleDeadlines++;
+                xSemaphoreGiveRecursive(txMutex);
                 return;
             }
-            // if in RX mode?
-            radio->receive(false);
-            Radio::clearFlags();
-            radio->tickCounter = 0;
-            radio->preCounter = 0;
-            return;
+            rxDeadlineLateness.record(now - rxDeadlineUs);
         }
+        const bool preambleActive = digitalRead(RADIO_PREAMBLE_DETECTED) && now - preambleStartUs < SM_PREAMBLE_MAX_US;
+        const RxStep step = rxTransition(state, event, {frequencyLocked, preambleActive, !packets2send.empty()});
+        rxStats.events[static_cast<uint8_t>(event)]++;
 
-        if (radioState == iohcRadio::RadioState::PREAMBLE) {
-            radio->tickCounter = 0;
-            radio->preCounter = radio->preCounter + 1;
-            //radio->preCounter += 1;
-
-            //            if (_flags[0] & RF_IRQFLAGS1_SYNCADDRESSMATCH) radio->preCounter = 0;
-            // In case of Sync received resets the preamble duration
-            if ((radio->preCounter * SM_GRANULARITY_US) >= SM_PREAMBLE_RECOVERY_TIMEOUT_US) {
-                // Avoid hanging on a too long preamble detect
+        if (step.actions & RX_COUNT_PREAMBLE) {
+            preambleStartUs = now;
+            hopPolicy.onPreamble(currentFreqIdx);
+        }
+        if (step.actions & RX_RECEIVE) {
+            Radio::readBytes(REG_IRQFLAGS1, _flags, sizeof(_flags));
+            if (_flags[0] & RF_IRQFLAGS1_TXREADY) {
+                // PacketSent of a transmission the TX engine already left
+                Radio::clearFlags();
+                Radio::setRx();
+            } else {
+                receive(true);
                 Radio::clearFlags();
-                radio->preCounter = 0;
             }
         }
+        if (step.actions & RX_LISTEN) {
+            Radio::clearFlags();
+            Radio::setRx();
+        }
+        if (step.actions & RX_CLEAR_FLAGS) {
+            // Avoid hanging on a too long preamble detect
+            Radio::clearFlags();
+            if (state == RadioState::PREAMBLE) rxStats.preambleRecoveries++;
+        }
+        if (step.actions & RX_HOP) hop();
+        if (step.next != state) setRadioState(step.next);
 
-        if (radioState != iohcRadio::RadioState::RX) return;
-
-        //if (++radio->tickCounter * SM_GRANULARITY_US < radio->scanTimeUs) return;
-        radio->tickCounter = radio->tickCounter + 1;
-        if (radio->tickCounter * SM_GRANULARITY_US < radio->scanTimeUs) return;
+        if (step.arm == RxTimer::Dwell && num_freqs) armRxTimer(hopPolicy.dwellUs(currentFreqIdx));
+        else if (step.arm == RxTimer::PreambleRecovery) armRxTimer(SM_PREAMBLE_RECOVERY_TIMEOUT_US);
+        xSemaphoreGiveRecursive(txMutex);
+    }
 
-        radio->tickCounter = 0;
+/**
+ * The `hop` function tunes the receiver to the next scanned channel. The caller must hold `txMutex`.
+ */
+    void iohcRadio::hop() {
+        if (num_freqs < 2) return;
 
-        if (radio->num_freqs == 1) return;
+        currentFreqIdx += 1;
+        if (currentFreqIdx >= num_freqs) {
+            currentFreqIdx = 0;
+            hopPolicy.onCycleEnd();
+        }
+        Radio::setFrequency(scanFrf[currentFreqIdx]);
+        rxStats.hops++;
+    }
 
-        radio->currentFreqIdx += 1;
-        if (radio->currentFreqIdx >= radio->num_freqs)
-            radio->currentFreqIdx = 0;
+    void iohcRadio::armRxTimer(uint32_t us) {
+        esp_timer_stop(rxTimer); // Not running is fine
+        rxDeadlineUs = esp_timer_get_time() + us;
+        esp_timer_start_once(rxTimer, us);
+    }
 
-        Radio::setCarrier(Radio::Carrier::Frequency, radio->scan_freqs[radio->currentFreqIdx]);
+    void iohcRadio::onRxTimer(void *arg) {
+        xTaskNotify(handle_interrupt, RX_NOTIFY_DEADLINE, eSetBits);
+    }
 
-#elif defined(CC1101)
+/**
+ * The `tickerCounter` function handles the CC1101 receiver, the SX127X one is driven by `rxEvent`.
+ *
+ * @param radio The `radio` parameter in the `iohcRadio::tickerCounter` function is a pointer to an
+ * instance of the `iohcRadio` class. This pointer is used to access and modify the properties and
+ * methods of the `iohcRadio` object within the function. The function uses this pointer
+ */
+    void IRAM_ATTR iohcRadio::tickerCounter(iohcRadio *radio) {
+        // Not need to put in IRAM as we reuse task for µs instead ISR
+#if defined(CC1101)
         if (__g_preamble){
             radio->receive();
             radio->tickCounter = 0;
@@ -282,77 +443,419 @@ namespace IOHC {
     }
     */
 
-void iohcRadio::queueSend(std::vector<iohcPacket *> &iohcTx) {
+/**
+ * The `queueSend` function appends a batch to the queue of its priority class. A batch with a
+ * coalesce key replaces a queued batch of the same key that has not started yet, keeping its place in
+ * the queue. The caller must hold `txMutex`.
+ *
+ * @return The request id, 0 if there was nothing to send.
+ */
+uint32_t iohcRadio::queueSend(std::vector<iohcPacketHandle> &iohcTx, TxPriority priority, uint32_t coalesceKey,
+                              TxDoneDelegate &onDone) {
     if (iohcTx.empty()) {
-        return;
+        return 0;
+    }
+    // The radio owns the packets until they are sent, then gives them back to the pool
+    std::vector<iohcPacket *> packets;
+    packets.reserve(iohcTx.size());
+    for (auto &packet : iohcTx)
+        if (packet) packets.push_back(packet.release()); // Empty handle: the pool ran out while building
+    iohcTx.clear();
+    if (packets.empty()) {
+        return 0;
+    }
+
+    const int64_t now = esp_timer_get_time();
+    TxReport report{txNextId++, TxStatus::Sent, packets.front()->payload.packet.header.cmd, now, 0, 0, 0};
+    if (!txNextId) txNextId = 1;
+
+    const auto cls = static_cast<uint8_t>(priority);
+    if (coalesceKey) {
+        for (auto &queued : sendQueues[cls]) {
+            if (queued.coalesceKey != coalesceKey || queued.resumed) continue;
+            for (auto p : queued.packets) iohcPacketPool::release(p);
+            completeRequest(queued.report, queued.onDone, TxStatus::Superseded);
+            queued.packets = std::move(packets);
+            queued.report = report;
+            queued.onDone = std::move(onDone);
+            txClassStats[cls].coalesced++;
+            iohcTrace::record(TraceEvent::TxCoalesced, cls, coalesceKey);
+            return report.id;
+        }
     }
-    sendQueue.push(std::move(iohcTx));
-    ets_printf("TX: Queued send batch. Queue depth=%d\n", static_cast<int>(sendQueue.size()));
+
+    sendQueues[cls].push_back({std::move(packets), now, false, coalesceKey, report, std::move(onDone)});
+    txClassStats[cls].batches++;
+    if (sendQueues[cls].size() > txClassStats[cls].highWater) txClassStats[cls].highWater = sendQueues[cls].size();
+    iohcTrace::record(TraceEvent::TxQueued, cls, sendQueues[cls].size());
+    return report.id;
 }
 
+/**
+ * The `completeRequest` function accounts a finished request to the latency histograms of its command
+ * and calls its completion handler. The handler runs with `txMutex` held, from the TX timer or from the
+ * task whose newer request superseded it, so it must be short; it may send again.
+ */
+void iohcRadio::completeRequest(TxReport &report, TxDoneDelegate &onDone, TxStatus status) {
+    report.status = status;
+    report.doneUs = esp_timer_get_time();
+
+    auto *slot = &txLatency[0];
+    while (slot < &txLatency[TX_LATENCY_CMDS] && slot->used && slot->cmd != report.cmd) slot++;
+    if (slot == &txLatency[TX_LATENCY_CMDS]) {
+        txLatencyUntracked++;
+    } else {
+        slot->used = true;
+        slot->cmd = report.cmd;
+        if (status == TxStatus::Superseded) {
+            slot->superseded++;
+        } else {
+            if (report.startUs) slot->toStart.record(report.startUs - report.queuedUs);
+            if (report.startUs && report.firstAirUs) slot->startToAir.record(report.firstAirUs - report.startUs);
+            slot->toDone.record(report.doneUs - report.queuedUs);
+        }
+    }
+
+    if (onDone) {
+        TxDoneDelegate handler = std::move(onDone);
+        onDone = nullptr;
+        handler(report);
+    }
+}
+
+/**
+ * The `startQueuedSend` function starts the oldest batch of the highest priority class waiting, unless
+ * a batch is already on air. The caller must hold `txMutex`.
+ */
 void iohcRadio::startQueuedSend() {
-    if (radioState == RadioState::TX || packets2send.size() > 0 || sendQueue.empty()) {
+    if (radioState == RadioState::TX || packets2send.size() > 0) {
+        return;
+    }
+    uint8_t cls = 0;
+    while (cls < TX_CLASSES && sendQueues[cls].empty()) cls++;
+    if (cls == TX_CLASSES) {
         return;
     }
 
-    packets2send = std::move(sendQueue.front());
-    sendQueue.pop();
+    // Background traffic waits while the sub-band budget runs low, replies and user commands always go
+    if (static_cast<TxPriority>(cls) == TxPriority::Background) {
+        const iohcPacket *first = sendQueues[cls].front().packets.front();
+        if (dutyCycle.isLow(first->frequency ? first->frequency : scan_freqs[currentFreqIdx])) {
+            if (!dutyRetryArmed) {
+                dutyCycle.onDeferred();
+                dutyRetryArmed = true;
+                DutyRetry.delay_ms(DUTY_RETRY_MS, &iohcRadio::onDutyRetry, (void*)this);
+            }
+            return;
+        }
+    }
+
+    TxBatch &batch = sendQueues[cls].front();
+    const int64_t queuedUs = batch.queuedUs;
+    txIrqDriven = txRepeatMode == TxRepeatMode::Irq;
+    if (!batch.resumed) txClassStats[cls].wait.record(esp_timer_get_time() - queuedUs);
+    packets2send = std::move(batch.packets);
+    txReport = batch.report;
+    if (!txReport.startUs) txReport.startUs = esp_timer_get_time(); // Kept when resumed after preemption
+    txDone = std::move(batch.onDone);
+    sendQueues[cls].pop_front();
+    txPriority = static_cast<TxPriority>(cls);
     txCounter = 0;
     txComplete = false;
-    ets_printf("TX: Preparing %d packet(s)\n", packets2send.size());
+    iohcTrace::record(TraceEvent::TxPrepare, packets2send.size());
     setRadioState(RadioState::TX);
 
+    scheduleCurrent(queuedUs, true);
+}
+
+void iohcRadio::onDutyRetry(void *arg) {
+    auto *radio = (iohcRadio *)arg;
+    xSemaphoreTakeRecursive(radio->txMutex, portMAX_DELAY);
+    radio->dutyRetryArmed = false;
+    radio->startQueuedSend();
+    xSemaphoreGiveRecursive(radio->txMutex);
+}
+
+/**
+ * The `scheduleCurrent` function puts the current packet on air at its deadline, `delayed` ms after
+ * `readyUs`. While waiting the receiver listens, so the answer the delay leaves room for is not missed.
+ * The caller must hold `txMutex`.
+ *
+ * @param readyUs Time the packet could go: queued time for the first packet, end of the previous one otherwise.
+ * @param first true for the first packet of a batch, sent with the long preamble waking the devices up.
+ */
+void iohcRadio::scheduleCurrent(int64_t readyUs, bool first) {
     auto packet = packets2send[txCounter];
+    txDueUs = readyUs + packet->delayed * 1000LL;
+    txFirstPending = first;
+
+    const int64_t waitUs = txDueUs - esp_timer_get_time();
+    if (waitUs >= 1000) {
+        Sender.detach();
+        stopTxTimer();
+        Radio::setRx();
+        setRadioState(RadioState::LOCKED); // Listen on the TX channel, no hop before the batch is done
+        txDeferred++;
+        Sender.delay_ms(waitUs / 1000, &iohcRadio::onTxDeadline, (void*)this);
+        return;
+    }
+    startCurrent();
+}
+
+void iohcRadio::onLbtTimer(void *arg) {
+    auto *radio = (iohcRadio *)arg;
+    xSemaphoreTakeRecursive(radio->txMutex, portMAX_DELAY);
+    radio->listenSample();
+    xSemaphoreGiveRecursive(radio->txMutex);
+}
 
-    // 🟢 Set long preamble for first packet
-    Radio::setPreambleLength(LONG_PREAMBLE_MS);
-    ets_printf("TX: Using LONG preamble (%d ms)\n", LONG_PREAMBLE_MS);
+/**
+ * The `listenSample` function takes one LBT sample of the open window, then transmits, backs off or
+ * waits for the next sample. The caller must hold `txMutex`.
+ */
+void iohcRadio::listenSample() {
+    if (!txListening || packets2send.empty()) return;
+    const auto verdict = carrierSense.sample();
+    if (verdict == iohcCarrierSense::Verdict::Listening) {
+        esp_timer_start_once(lbtTimer, LBT_SAMPLE_US);
+        return;
+    }
+    txListening = false;
+    if (verdict == iohcCarrierSense::Verdict::Busy) {
+        if (txBackoffs < LBT_MAX_BACKOFFS) {
+            const uint32_t backoffMs = carrierSense.backoffMs(txBackoffs++);
+            iohcTrace::record(TraceEvent::TxBackoff, backoffMs, txBackoffs);
+            setRadioState(RadioState::LOCKED); // No hop before the batch is done
+            Sender.delay_ms(backoffMs, &iohcRadio::onTxDeadline, (void*)this);
+            return;
+        }
+        carrierSense.onForced();
+    }
+    txChannelClear = true;
+    startCurrent();
+}
 
-    // Send first packet immediately
-    Radio::setStandby();
-    Radio::clearFlags();
-    Radio::writeBytes(REG_FIFO, packet->payload.buffer, packet->buffer_length);
-    Radio::setTx();
-    //packetStamp = esp_timer_get_time();
-    //packet->decode(true); //false);
-    //IOHC::lastSendCmd = packet->payload.packet.header.cmd;
+void iohcRadio::onTxDeadline(void *arg) {
+    auto *radio = (iohcRadio *)arg;
+    xSemaphoreTakeRecursive(radio->txMutex, portMAX_DELAY);
+    if (!radio->preemptCurrent()) radio->startCurrent();
+    xSemaphoreGiveRecursive(radio->txMutex);
+}
 
-    ets_printf("TX: Sent first packet (%d repeats) at %llu us\n", iohc->repeat, esp_timer_get_time());
+/**
+ * The `startCurrent` function sends the first transmission of the current packet, after a clear channel
+ * check when listen-before-talk is on, and makes sure the ticker driving its repeats runs. The check
+ * does not block: it opens the window and `listenSample` calls back here with the verdict. The caller
+ * must hold `txMutex`.
+ */
+void iohcRadio::startCurrent() {
+    auto packet = packets2send[txCounter];
+
+    // 👂 Listen before talk, except for replies: the peer just spoke and waits for us
+    if (carrierSense.isEnabled() && txPriority != TxPriority::Reply && !txChannelClear) {
+        Sender.detach();
+        stopTxTimer();
+        Radio::setStandby();
+        tuneTx(packet);
+        Radio::setRx();
+        setRadioState(RadioState::TX); // The scan must not hop away from the TX channel while listening
+        txListening = true;
+        carrierSense.begin();
+        esp_timer_start_once(lbtTimer, LBT_SETTLE_US);
+        return;
+    }
+    txChannelClear = false;
+    txBackoffs = 0;
 
+    const int64_t now = esp_timer_get_time();
+    if (packet->delayed) txLateness.record(now > txDueUs ? now - txDueUs : 0);
 
+    // 🟢 Long preamble for the first packet, short for the next ones and repeats
+    transmit(packet, txFirstPending ? LONG_PREAMBLE_MS : SHORT_PREAMBLE_MS);
+    if (!txReport.firstAirUs) txReport.firstAirUs = now;
+    iohcTrace::record(TraceEvent::TxSent, txCounter + 1, packet->repeat);
     if (packet->repeat > 0) packet->repeat--;
 
-    // Start ticker for repeats (short preamble)
-    Sender.attach_ms(packet->repeatTime, &iohcRadio::onTxTicker, (void*)this);
+    // Start ticker for repeats, unless it still runs from the previous packet. PacketSent paces them in Irq mode
+    if (!txIrqDriven && !Sender.active()) Sender.attach_ms(packet->repeatTime, &iohcRadio::onTxTicker, (void*)this);
+}
+
+/**
+ * The `transmit` function tunes to the packet frequency and starts the transmission. The caller must
+ * hold `txMutex`.
+ */
+void iohcRadio::transmit(iohcPacket *packet, uint16_t preambleMs) {
+    txComplete = false;
+    setRadioState(RadioState::TX);
+
+    // Standby, carrier, preamble, flags, FIFO and TX mode in a single SPI bus transaction
+    Radio::startTx(frfForTx(packet), preambleMs, packet->payload.buffer, packet->buffer_length);
+    txStartUs = esp_timer_get_time();
+    const uint32_t airtimeUs = iohcDutyCycle::airtimeUs(preambleMs, packet->buffer_length, IOHC_BITRATE);
+    dutyCycle.record(txCarrier, airtimeUs);
+    // Watchdog in case the PacketSent interrupt is missed, txTick then finds it in IRQFLAGS2
+    if (txIrqDriven) armTxTimer(airtimeUs + TX_IRQ_MARGIN_US);
+}
+
+void iohcRadio::armTxTimer(int64_t us) {
+    esp_timer_stop(txTimer); // Not running is fine
+    esp_timer_start_once(txTimer, us > 0 ? us : 0);
+}
+
+void iohcRadio::stopTxTimer() {
+    esp_timer_stop(txTimer);
+}
+
+void iohcRadio::onTxTimer(void *arg) {
+    auto *radio = (iohcRadio *)arg;
+    xSemaphoreTakeRecursive(radio->txMutex, portMAX_DELAY);
+    if (radio->txIrqDriven && !radio->packets2send.empty()) radio->txTick();
+    xSemaphoreGiveRecursive(radio->txMutex);
+}
+
+/**
+ * The `onPacketSent` function is called by the radio task after DIO0 signalled PacketSent. In Irq mode
+ * it replaces the watchdog by `txTick`, which times the next repeat or packet from there.
+ */
+void iohcRadio::onPacketSent() {
+    xSemaphoreTakeRecursive(txMutex, portMAX_DELAY);
+    // A frame received during the LBT window raises the same DIO0, nothing was sent yet
+    if (txIrqDriven && !txListening && !packets2send.empty() && radioState != RadioState::TX) {
+        txComplete = true;
+        stopTxTimer();
+        txTick();
+    }
+    xSemaphoreGiveRecursive(txMutex);
+}
+
+/**
+ * The `setTxRepeatMode` function selects how repeats are paced, from the next batch on.
+ */
+void iohcRadio::setTxRepeatMode(TxRepeatMode mode) {
+    xSemaphoreTakeRecursive(txMutex, portMAX_DELAY);
+    txRepeatMode = mode;
+    xSemaphoreGiveRecursive(txMutex);
+}
+
+/**
+ * The `frfForTx` function returns the FRF registers of the packet frequency, the scan one when it is 0,
+ * and accounts the retune when it differs from the carrier the TX engine tuned last.
+ */
+Radio::Frf iohcRadio::frfForTx(const iohcPacket *packet) {
+    const uint32_t frequency = packet->frequency ? packet->frequency : scan_freqs[currentFreqIdx];
+    uint8_t idx = 0;
+    while (idx < num_freqs && scan_freqs[idx] != frequency) idx++;
+    if (frequency != txCarrier) {
+        txCarrier = frequency;
+        txRetunes++;
+    }
+    return idx < num_freqs ? scanFrf[idx] : Radio::frfFor(frequency);
+}
+
+/**
+ * The `tuneTx` function sets the carrier to the packet frequency. Unchanged FRF registers are not
+ * written again, see the shadow registers.
+ */
+void iohcRadio::tuneTx(const iohcPacket *packet) {
+    Radio::setFrequency(frfForTx(packet));
+}
+
+/**
+ * The `restoreScanCarrier` function returns to the scan frequency after a batch sent on another one.
+ */
+void iohcRadio::restoreScanCarrier() {
+    if (txCarrier && txCarrier != scan_freqs[currentFreqIdx])
+        Radio::setFrequency(scanFrf[currentFreqIdx]);
+    txCarrier = 0;
+}
+
+/**
+ * The `preemptCurrent` function suspends the batch on air between two packets when a batch of a higher
+ * class is waiting. The packets not sent yet go back to the head of their class queue and resume once
+ * the higher classes are empty. The caller must hold `txMutex`.
+ *
+ * @return true if the current batch was suspended and the higher class batch started.
+ */
+bool iohcRadio::preemptCurrent() {
+    const auto cls = static_cast<uint8_t>(txPriority);
+    uint8_t higher = 0;
+    while (higher < cls && sendQueues[higher].empty()) higher++;
+    if (higher == cls) {
+        return false;
+    }
+
+    Sender.detach();
+    stopTxTimer();
+    std::vector<iohcPacket *> remaining(packets2send.begin() + txCounter, packets2send.end());
+    for (uint8_t i = 0; i < txCounter; i++) iohcPacketPool::release(packets2send[i]);
+    packets2send.clear();
+    sendQueues[cls].push_front({std::move(remaining), esp_timer_get_time(), true, 0, txReport, std::move(txDone)});
+    txDone = nullptr;
+    txClassStats[cls].preempted++;
+    iohcTrace::record(TraceEvent::TxPreempted, cls, higher);
+
+    setRadioState(frequencyLocked ? RadioState::LOCKED : RadioState::RX);
+    startQueuedSend();
+    return true;
 }
 
-void iohcRadio::send(iohcPacket *packet) {
-    std::vector<iohcPacket *> packets = { packet };
-    send(packets);
+/**
+ * The `send` function queues packets for transmission in their priority class.
+ *
+ * @param coalesceKey Non zero to replace a queued request of the same key, see `coalesceKey()`.
+ * @param onDone Called once all packets and repeats went on air, or when a newer request superseded this one.
+ *
+ * @return The request id reported to `onDone`, 0 if there was nothing to send.
+ */
+uint32_t iohcRadio::send(iohcPacketHandle packet, TxPriority priority, uint32_t coalesceKey, TxDoneDelegate onDone) {
+    if (!packet) {
+        return 0;
+    }
+    std::vector<iohcPacketHandle> packets;
+    packets.push_back(std::move(packet));
+    return send(packets, priority, coalesceKey, std::move(onDone));
 }
 
-void iohcRadio::send(std::vector<iohcPacket *> &iohcTx) {
-    queueSend(iohcTx);
+uint32_t iohcRadio::send(std::vector<iohcPacketHandle> &iohcTx, TxPriority priority, uint32_t coalesceKey,
+                         TxDoneDelegate onDone) {
+    xSemaphoreTakeRecursive(txMutex, portMAX_DELAY);
+    const uint32_t id = queueSend(iohcTx, priority, coalesceKey, onDone);
     startQueuedSend();
+    xSemaphoreGiveRecursive(txMutex);
+    return id;
 }
 
 
  
 void iohcRadio::onTxTicker(void *arg) {
     iohcRadio *radio = (iohcRadio *)arg;
-    auto packet = radio->packets2send[radio->txCounter];
+    // send() is called from the console, MQTT, web and dispatch tasks while this runs in the esp_timer task
+    xSemaphoreTakeRecursive(radio->txMutex, portMAX_DELAY);
+    radio->txTick();
+    xSemaphoreGiveRecursive(radio->txMutex);
+}
+
+/**
+ * The `txTick` function is the body of the TX ticker: it waits for TXDONE, then sends the next repeat
+ * or the next packet of the batch. The caller must hold `txMutex`.
+ */
+void iohcRadio::txTick() {
+    auto packet = packets2send[txCounter];
 
     // 🩵 Fallback: Check IRQFLAGS2 (0x3F) for PacketSent in FSK mode
     uint8_t irqFlags2 = Radio::readByte(0x3F); // REG_IRQFLAGS2
     if (irqFlags2 & 0x08) { // Bit 3 == PacketSent (TXDONE in FSK)
-        ets_printf("FSK: Detected PacketSent (TXDONE) via register (ISR missed?)\n");
+        iohcTrace::record(TraceEvent::TxDoneByReg);
         Radio::writeByte(0x3F, 0x08); // Clear PacketSent bit
+        if (!iohcRadio::txComplete) irqStamp = esp_timer_get_time();
         iohcRadio::txComplete = true;
     }
 
     // ⏳ Wait for TXDONE
-    if (!radio->txComplete) {
-        ets_printf("TX: Waiting for TXDONE... (state=%s)\n", radioStateToString(radio->radioState));
+    if (!txComplete) {
+        iohcTrace::record(TraceEvent::TxWaiting, static_cast<uint8_t>(radioState));
+        txWaitTicks++;
+        if (txIrqDriven) armTxTimer(TX_IRQ_MARGIN_US);
         return;
     }
 
@@ -361,53 +864,45 @@ void iohcRadio::onTxTicker(void *arg) {
 
     // 🔁 Repeat logic
     if (packet->repeat > 0) {
-        packet->repeat--;
-        ets_printf("TX: Repeating current packet (%d repeats left)\n", packet->repeat);
-    } else {
-        // inform callback we finished sending this packet
-        radio->sent(radio->iohc);
-
-        radio->txCounter++;
-
-
-        // 🛑 Check if all packets are sent
-        if (radio->txCounter == radio->packets2send.size()) {
-            ets_printf("TX: All packets sent. Stopping Ticker.\n");
-            radio->Sender.detach();
-            for (auto p : radio->packets2send) delete p;
-            radio->packets2send.clear();
-            Radio::setRx();
-            radio->setRadioState(RadioState::RX);
-            radio->startQueuedSend();
+        const int64_t due = txStartUs + packet->repeatTime * 1000LL;
+        const int64_t now = esp_timer_get_time();
+        // In Irq mode wait out the exact gap, the ticker period already provides it
+        if (txIrqDriven && due > now) {
+            armTxTimer(due - now);
             return;
         }
-
-        radio->iohc = radio->packets2send[radio->txCounter];
-        ets_printf("TX: Moving to next packet %d/%d (repeat=%d)\n",
-                    radio->txCounter + 1,
-                    radio->packets2send.size(),
-                    radio->iohc->repeat);
+        packet->repeat--;
+        iohcTrace::record(TraceEvent::TxRepeat, packet->repeat);
+        txRepeatJitter.record(now > due ? now - due : due - now);
+        transmit(packet, SHORT_PREAMBLE_MS);
+        return;
     }
 
-    radio->txComplete = false;
+    // inform callback we finished sending this packet
+    sent(packet);
 
-    //Radio::setRx();
-    radio->setRadioState(RadioState::TX); // Stay TX until done
+    txCounter++;
 
-    // 📡 Send next packet (short preamble)
-    Radio::setPreambleLength(SHORT_PREAMBLE_MS);
-    Radio::setStandby();
-    Radio::clearFlags();
-    Radio::writeBytes(REG_FIFO, packet->payload.buffer, packet->buffer_length);
-    Radio::setTx();
-    //packetStamp = esp_timer_get_time();
-    //packet->decode(true); //false);
-    //IOHC::lastSendCmd = packet->payload.packet.header.cmd;
+    // 🛑 Check if all packets are sent
+    if (txCounter == packets2send.size()) {
+        iohcTrace::record(TraceEvent::TxBatchDone, txCounter);
+        Sender.detach();
+        stopTxTimer();
+        for (auto p : packets2send) iohcPacketPool::release(p);
+        packets2send.clear();
+        restoreScanCarrier();
+        Radio::setRx();
+        setRadioState(frequencyLocked ? RadioState::LOCKED : RadioState::RX);
+        completeRequest(txReport, txDone, TxStatus::Sent);
+        startQueuedSend();
+        return;
+    }
+
+    // ⏫ Let a waiting higher class batch go first
+    if (preemptCurrent()) return;
 
-    ets_printf("TX: Sent packet %d/%d at %llu us\n",
-               radio->txCounter + 1,
-               radio->packets2send.size(),
-               esp_timer_get_time());
+    iohcTrace::record(TraceEvent::TxNext, txCounter + 1, packets2send[txCounter]->delayed);
+    scheduleCurrent(esp_timer_get_time(), false);
 }
 
 /**
@@ -423,9 +918,13 @@ void iohcRadio::onTxTicker(void *arg) {
     bool IRAM_ATTR iohcRadio::sent(iohcPacket *packet) {
         bool ret = false;
         if (packet) {
-            packetStamp = esp_timer_get_time();
+            trackExchange(packet);
+            packet->stamp = irqStamp;
+            packetStamp = packet->stamp;
             packet->decode(true);
-            addLogMessage(String(packet->decodeToString(true).c_str()));
+            char line[IOHC_SUMMARY_LEN];
+            packet->summarize(line, sizeof(line));
+            addLogMessage(line);
         }
         if (txCB) {
             ret = txCB(packet);
@@ -448,20 +947,30 @@ void iohcRadio::onTxTicker(void *arg) {
     bool IRAM_ATTR iohcRadio::receive(bool stats = false) {
         digitalWrite(RX_LED, digitalRead(RX_LED) ^ 1);
         // bool frmErr = false;
-        iohc = new iohcPacket;
-        iohc->buffer_length = 0;
+        iohc = rxRing.claim();
+        if (!iohc) {
+            // Consumers are behind and every slot is in use: drop this frame
+#if defined(RADIO_SX127X)
+            Radio::clearBuffer();
+#endif
+            digitalWrite(RX_LED, false);
+            return false;
+        }
         iohc->frequency = scan_freqs[currentFreqIdx];
 
-        _g_payload_millis = esp_timer_get_time();
-        packetStamp = _g_payload_millis;
+        iohc->stamp = irqStamp;
 #if defined(RADIO_SX127X)
+        // CRCAUTOCLEAR_OFF hands over frames failing the CRC too, flag them before anything acts on them
+        if (!(_flags[1] & RF_IRQFLAGS2_CRCOK)) iohc->rxErrors |= RX_ERROR_CRC;
         if (stats) {
-            iohc->rssi = static_cast<float>(Radio::readByte(REG_RSSIVALUE)) / -2.0f;
-            int16_t thres = Radio::readByte(REG_RSSITHRESH);
-            iohc->snr = iohc->rssi > thres ? 0 : (thres - iohc->rssi);
+            // One burst from RSSITHRESH (0x10) to AFCLSB (0x1C) instead of four single reads
+            uint8_t regs[REG_AFCLSB - REG_RSSITHRESH + 1];
+            Radio::readBytes(REG_RSSITHRESH, regs, sizeof(regs));
+            iohc->rssi = static_cast<float>(regs[REG_RSSIVALUE - REG_RSSITHRESH]) / -2.0f;
+            const float threshold = static_cast<float>(regs[0]) / -2.0f;
+            iohc->snr = iohc->rssi > threshold ? static_cast<uint8_t>(iohc->rssi - threshold) : 0;
             //            iohc->lna = RF96lnaMap[ (Radio::readByte(REG_LNA) >> 5) & 0x7 ];
-            int16_t f = (uint16_t) Radio::readByte(REG_AFCMSB);
-            f = (f << 8) | (uint16_t) Radio::readByte(REG_AFCLSB);
+            const auto f = static_cast<int16_t>((regs[REG_AFCMSB - REG_RSSITHRESH] << 8) | regs[REG_AFCLSB - REG_RSSITHRESH]);
             //            iohc->afc = f * (32000000.0 / 524288.0); // static_cast<float>(1 << 19));
             iohc->afc = /*(int32_t)*/f * 61.0;
             //            iohc->rssiAt = micros();
@@ -482,9 +991,33 @@ void iohcRadio::onTxTicker(void *arg) {
 
 #if defined(RADIO_SX127X)
 
-        while (Radio::dataAvail()) {
+        const uint32_t drainStart = ESP.getCycleCount();
+        if (fifoBurstRead && Radio::dataAvail()) {
+            // CtrlByte1.MsgLen is the number of bytes following it: pull them in a single burst
+            iohc->payload.buffer[0] = Radio::readByte(REG_FIFO);
+            iohc->buffer_length = 1;
+            const uint8_t remaining = iohc->payload.packet.header.CtrlByte1.asStruct.MsgLen;
+            if (remaining) {
+                Radio::readBytes(REG_FIFO, iohc->payload.buffer + 1, remaining);
+                iohc->buffer_length += remaining;
+            }
+        }
+        // Byte-wise drain, also catches anything left behind a short MsgLen
+        while (Radio::dataAvail() && iohc->buffer_length < MAX_FRAME_LEN) {
             iohc->payload.buffer[iohc->buffer_length++] = Radio::readByte(REG_FIFO);
         }
+        const uint32_t drainCycles = ESP.getCycleCount() - drainStart;
+        if (iohc->buffer_length != iohc->payload.packet.header.CtrlByte1.asStruct.MsgLen + 1)
+            iohc->rxErrors |= RX_ERROR_LENGTH;
+        // Noise must neither lock the channel nor weigh on the dwell, only link stats see a bad frame
+        if (!(iohc->rxErrors & (RX_ERROR_CRC | RX_ERROR_LENGTH))) {
+            hopPolicy.onFrame(currentFreqIdx);
+            if (iohc->buffer_length) trackExchange(iohc);
+        }
+        rxDrainCycles += drainCycles;
+        rxDrainFrames++;
+        rxDrainBytes += iohc->buffer_length;
+        if (drainCycles > rxDrainCyclesMax) rxDrainCyclesMax = drainCycles;
 
 #elif defined(CC1101)
         uint8_t lenghtFrameCoded = 0xFF;
@@ -525,13 +1058,14 @@ void iohcRadio::onTxTicker(void *arg) {
         if (lenghtFrameCoded<255){
             int8_t lenFuncDecodeFrame = Radio::decodeFrame(tmpBuffer, lenghtFrameCoded);
             if (lenFuncDecodeFrame>0 && lenFuncDecodeFrame<=MAX_FRAME_LEN){
-                if (iohcUtils::radioPacketComputeCrc(tmpBuffer, lenFuncDecodeFrame) == 0 ){
+                if (iohcCrypto::radioPacketComputeCrc(tmpBuffer, lenFuncDecodeFrame) == 0 ){
                     iohc->buffer_length = lenFuncDecodeFrame;
                     memcpy(iohc->payload.buffer, tmpBuffer, lenFuncDecodeFrame);  // volcamos el resultado al array de origen
                     frmErr=false;
                 }
             }
         }
+        if (!frmErr) hopPolicy.onFrame(currentFreqIdx);
 
         // Flush then standby according to RXOFF_MODE (default: RADIOLIB_CC1101_RXOFF_IDLE)
         if (Radio::SPIgetRegValue(REG_MCSM1, 3, 2) == RF_RXOFF_IDLE) {
@@ -544,16 +1078,238 @@ void iohcRadio::onTxTicker(void *arg) {
 
 #endif
 
-        // Radio::clearFlags();
-        if (rxCB) rxCB(iohc);
-        iohc->decode(true); //stats);
-        addLogMessage(String(iohc->decodeToString(true).c_str()));
-        //free(iohc); // correct Bug memory
-        delete iohc;
+        iohc->queuedStamp = esp_timer_get_time();
+        rxRing.publish();
+        rxPublished++;
+        const size_t depth = rxRing.depth();
+        if (depth > rxHighWater) rxHighWater = depth;
+        xTaskNotifyGive(handle_dispatch);
         digitalWrite(RX_LED, false);
         return true;
     }
 
+/**
+ * The `dispatchReceived` function hands every frame published in the RX ring to the receive callback,
+ * decodes and logs it, then gives the slot back to the radio.
+ */
+    void iohcRadio::dispatchReceived() {
+        while (iohcPacket *packet = rxRing.peek()) {
+            linkStats.record(packet);
+            // Counted above, a frame failing its CRC goes no further
+            if (packet->rxErrors & RX_ERROR_CRC) {
+                rxRing.release();
+                continue;
+            }
+            if (dedup.isDuplicate(packet)) {
+                rxRing.release();
+                continue;
+            }
+            packetStamp = packet->stamp;
+            packet->dispatchedStamp = esp_timer_get_time();
+            if (rxCB) rxCB(packet);
+            packet->decode(true); //stats);
+            char line[IOHC_SUMMARY_LEN];
+            packet->summarize(line, sizeof(line));
+            addLogMessage(line);
+
+            rxLatency.isrToQueued.record(packet->queuedStamp - packet->stamp);
+            rxLatency.queuedToDispatched.record(packet->dispatchedStamp - packet->queuedStamp);
+            if (packet->publishedStamp) {
+                rxLatency.dispatchedToPublished.record(packet->publishedStamp - packet->dispatchedStamp);
+                rxLatency.isrToPublished.record(packet->publishedStamp - packet->stamp);
+            }
+            rxRing.release();
+            rxDispatched++;
+        }
+    }
+
+/**
+ * The `dumpStats` function prints the radio pipeline counters to the console.
+ */
+    void iohcRadio::dumpStats() {
+        const uint32_t frames = rxDrainFrames ? rxDrainFrames : 1;
+        printf("RX FIFO drain (%s): avg %u cycles/frame, max %u, avg %u cycles/byte\n",
+               fifoBurstRead ? "burst" : "byte-wise",
+               static_cast<unsigned>(rxDrainCycles / frames), static_cast<unsigned>(rxDrainCyclesMax),
+               static_cast<unsigned>(rxDrainBytes ? rxDrainCycles / rxDrainBytes : 0));
+        printf("RX ring: depth %u/%u, high water %u, published %u, dispatched %u, dropped %u\n",
+               static_cast<unsigned>(rxRing.depth()), static_cast<unsigned>(rxRing.capacity()),
+               static_cast<unsigned>(rxHighWater), static_cast<unsigned>(rxPublished),
+               static_cast<unsigned>(rxDispatched), static_cast<unsigned>(rxRing.drops()));
+        const uint32_t locksEnded = locksCompleted + locksTimedOut;
+        printf("2W locks: %u started, %u completed, %u timed out, avg %ums, max %ums%s\n",
+               static_cast<unsigned>(locksStarted), static_cast<unsigned>(locksCompleted),
+               static_cast<unsigned>(locksTimedOut),
+               static_cast<unsigned>(locksEnded ? lockTotalUs / locksEnded / 1000 : 0),
+               static_cast<unsigned>(lockMaxUs / 1000), frequencyLocked ? " (locked)" : "");
+        static const char *txClassNames[TX_CLASSES] = {"reply", "interactive", "background"};
+        xSemaphoreTakeRecursive(txMutex, portMAX_DELAY);
+        for (uint8_t cls = 0; cls < TX_CLASSES; cls++) {
+            const auto &stats = txClassStats[cls];
+            printf("TX %-11s: %u batches, depth %u (max %u), %u preempted, %u coalesced, wait p50<=%ums p99<=%ums max %ums\n",
+                   txClassNames[cls], static_cast<unsigned>(stats.batches),
+                   static_cast<unsigned>(sendQueues[cls].size()), static_cast<unsigned>(stats.highWater),
+                   static_cast<unsigned>(stats.preempted), static_cast<unsigned>(stats.coalesced), static_cast<unsigned>(stats.wait.percentile(50) / 1000),
+                   static_cast<unsigned>(stats.wait.percentile(99) / 1000), static_cast<unsigned>(stats.wait.max() / 1000));
+        }
+        printf("TX timing: %u packets deferred, %u retunes, repeats paced by %s, %u ticks before TXDONE\n",
+               static_cast<unsigned>(txDeferred), static_cast<unsigned>(txRetunes),
+               txRepeatMode == TxRepeatMode::Irq ? "PacketSent" : "ticker", static_cast<unsigned>(txWaitTicks));
+        txLateness.print("TX deadline lateness");
+        txRepeatJitter.print("TX repeat gap error");
+        iohcPacketPool::dump();
+        carrierSense.dump();
+        dutyCycle.dump();
+        xSemaphoreGiveRecursive(txMutex);
+#if defined(RADIO_SX127X)
+        Radio::dumpShadowStats();
+#endif
+        dedup.dump();
+        printf("RX events: %u preamble, %u payload, %u deadlines (%u stale), %u hops, %u preamble recoveries\n",
+               static_cast<unsigned>(rxStats.events[static_cast<uint8_t>(RxEvent::Preamble)]),
+               static_cast<unsigned>(rxStats.events[static_cast<uint8_t>(RxEvent::Payload)]),
+               static_cast<unsigned>(rxStats.events[static_cast<uint8_t>(RxEvent::Deadline)]),
+               static_cast<unsigned>(rxStats.staleDeadlines), static_cast<unsigned>(rxStats.hops),
+               static_cast<unsigned>(rxStats.preambleRecoveries));
+        rxDeadlineLateness.print("RX deadline lateness");
+        hopPolicy.dump();
+    }
+
+/**
+ * The `trackExchange` function follows 2W exchanges from their control byte: a frame with EndFrame set
+ * completes the exchange, any other 2W frame starts it or extends it. 1W frames are ignored.
+ */
+    void iohcRadio::trackExchange(const iohcPacket *packet) {
+        const auto &ctrl = packet->payload.packet.header.CtrlByte1.asStruct;
+        if (ctrl.Protocol) return;
+        if (ctrl.EndFrame) releaseChannel(true);
+        else lockChannel();
+    }
+
+/**
+ * The `lockChannel` function stops the frequency scan on the current channel, or pushes back the
+ * deadline of a lock already held, until the exchange completes or SM_LOCK_TIMEOUT_US expires.
+ */
+    void iohcRadio::lockChannel() {
+        const int64_t now = esp_timer_get_time();
+        portENTER_CRITICAL(&lockMux);
+        if (!frequencyLocked) {
+            frequencyLocked = true;
+            lockStartUs = now;
+            locksStarted++;
+        }
+        lockDeadlineUs = now + SM_LOCK_TIMEOUT_US;
+        portEXIT_CRITICAL(&lockMux);
+        // Under txMutex, the TX engine may be switching to TX right now
+        xSemaphoreTakeRecursive(txMutex, portMAX_DELAY);
+        if (radioState == RadioState::RX) setRadioState(RadioState::LOCKED);
+        xSemaphoreGiveRecursive(txMutex);
+    }
+
+/**
+ * The `releaseChannel` function resumes the frequency scan and accounts the lock duration.
+ *
+ * @param completed true when the exchange ended with an EndFrame, false when the lock timed out.
+ */
+    void iohcRadio::releaseChannel(bool completed) {
+        const int64_t now = esp_timer_get_time();
+        portENTER_CRITICAL(&lockMux);
+        if (!frequencyLocked) {
+            portEXIT_CRITICAL(&lockMux);
+            return;
+        }
+        frequencyLocked = false;
+        const uint32_t heldUs = (completed ? now : lockDeadlineUs) - lockStartUs;
+        lockTotalUs += heldUs;
+        if (heldUs > lockMaxUs) lockMaxUs = heldUs;
+        if (completed) locksCompleted++;
+        else locksTimedOut++;
+        portEXIT_CRITICAL(&lockMux);
+        // A TX batch in progress keeps LOCKED, rxTransition releases it once done
+        xSemaphoreTakeRecursive(txMutex, portMAX_DELAY);
+        if (radioState == RadioState::LOCKED && packets2send.empty()) setRadioState(RadioState::RX);
+        xSemaphoreGiveRecursive(txMutex);
+    }
+
+    void iohcRadio::checkLockTimeout() {
+        if (frequencyLocked && esp_timer_get_time() >= lockDeadlineUs) releaseChannel(false);
+    }
+
+/**
+ * The `dumpLatency` function prints the per-stage latency percentiles of received frames, then per command
+ * of sent requests the queue wait, batch start to first air and queued to last repeat latencies.
+ */
+    void iohcRadio::dumpLatency() {
+        rxLatency.isrToQueued.print("IRQ -> queued");
+        rxLatency.queuedToDispatched.print("queued -> dispatched");
+        rxLatency.dispatchedToPublished.print("dispatched -> published");
+        rxLatency.isrToPublished.print("IRQ -> published");
+        for (const auto &slot : txLatency) {
+            if (!slot.used) continue;
+            char name[32];
+            snprintf(name, sizeof(name), "TX 0x%02x queued -> start", slot.cmd);
+            slot.toStart.print(name);
+            snprintf(name, sizeof(name), "TX 0x%02x start -> air", slot.cmd);
+            slot.startToAir.print(name);
+            snprintf(name, sizeof(name), "TX 0x%02x queued -> done", slot.cmd);
+            slot.toDone.print(name);
+            if (slot.superseded) printf("TX 0x%02x superseded: %u\n", slot.cmd, static_cast<unsigned>(slot.superseded));
+        }
+        if (txLatencyUntracked) printf("TX untracked commands: %u\n", static_cast<unsigned>(txLatencyUntracked));
+    }
+
+    void iohcRadio::resetTxLatency() {
+        xSemaphoreTakeRecursive(txMutex, portMAX_DELAY);
+        for (auto &slot : txLatency) slot = {};
+        txLatencyUntracked = 0;
+        xSemaphoreGiveRecursive(txMutex);
+    }
+
+/**
+ * The `setFifoBurstRead` function selects between the single-burst and the byte-wise FIFO drain
+ * and restarts the drain cycle counters so both paths can be compared.
+ */
+    void iohcRadio::setFifoBurstRead(bool enable) {
+        fifoBurstRead = enable;
+        rxDrainCycles = 0;
+        rxDrainCyclesMax = 0;
+        rxDrainFrames = 0;
+        rxDrainBytes = 0;
+    }
+
+/**
+ * The `benchSpi` function runs the SPI bench of the radio driver, only while the receiver scans with
+ * nothing to send: no batch on air, delayed or backing off, no locked exchange, no frame coming in.
+ * It holds `txMutex` so no batch can start during the bench, then tunes the scan channel back and
+ * arms its dwell again.
+ *
+ * @return false if the radio is busy, the bench did not run.
+ */
+    bool iohcRadio::benchSpi(uint16_t rounds) {
+#if defined(RADIO_SX127X)
+        xSemaphoreTakeRecursive(txMutex, portMAX_DELAY);
+        bool idle = radioState == RadioState::RX && packets2send.empty() && !frequencyLocked;
+        for (const auto &queue : sendQueues) idle = idle && queue.empty();
+        if (!idle) {
+            xSemaphoreGiveRecursive(txMutex);
+            return false;
+        }
+        esp_timer_stop(rxTimer);
+        Radio::benchSpi(rounds);
+        // A preamble caught between two transitions is gone, its events find the receiver listening
+        Radio::clearFlags();
+        Radio::setFrequency(scanFrf[currentFreqIdx]);
+        txCarrier = 0;
+        Radio::setRx();
+        setRadioState(RadioState::RX);
+        armRxTimer(hopPolicy.dwellUs(currentFreqIdx));
+        xSemaphoreGiveRecursive(txMutex);
+        return true;
+#else
+        return false;
+#endif
+    }
+
 /**
  * The `i_preamble` interrupt handler updates the radio state when a preamble is
  * detected on the current channel.
@@ -597,6 +1353,6 @@ void iohcRadio::onTxTicker(void *arg) {
         radioState = newState;
         // Optional debug:
         //printf("State changed to: %d\n", static_cast<int>(newState));
-        ets_printf("State: %s\n", radioStateToString(newState));
+        iohcTrace::record(TraceEvent::State, static_cast<uint8_t>(newState));
     }
 }
@@ -19,6 +19,7 @@
 #include <ArduinoJson.h>
 
 #include <iohcCryptoHelpers.h>
+#include <iohcFrameBuilder.h>
 #include <esp_system.h>
 #include <oled_display.h>
 #include <TickerUsESP32.h>
@@ -75,30 +76,18 @@ namespace IOHC {
         return _iohcRemote1W;
     }
 
-    void iohcRemote1W::forgePacket(iohcPacket* packet, uint16_t typn) {
+    iohcFrameBuilder iohcRemote1W::forgePacket(iohcPacket* packet, uint16_t typn) {
         IOHC::relStamp = esp_timer_get_time();
         digitalWrite(RX_LED, digitalRead(RX_LED) ^ 1);
 
-        packet->payload.packet.header.CtrlByte1.asStruct.MsgLen = sizeof(_header) - 1;
-        packet->payload.packet.header.CtrlByte1.asStruct.Protocol = 1;
-        packet->payload.packet.header.CtrlByte1.asStruct.StartFrame = 1;
-        packet->payload.packet.header.CtrlByte1.asStruct.EndFrame = 1;
-        packet->payload.packet.header.CtrlByte2.asByte = 0;
-        packet->payload.packet.header.CtrlByte2.asStruct.LPM = 1;
-        // Broadcast Target
-        uint16_t bcast = (typn << 6) + 0b111111; 
-        packet->payload.packet.header.target[0] = 0x00;
-        packet->payload.packet.header.target[1] = bcast >> 8;
-        packet->payload.packet.header.target[2] = bcast & 0x00ff;
-
         packet->frequency = CHANNEL2;
         packet->repeatTime = 40; //40ms
         packet->repeat = 4;
         packet->lock = false;
-        
-    }
 
-    std::vector<uint8_t> frame;
+        // Broadcast Target
+        return iohcFrameBuilder(packet, true).lowPower(true).broadcast((typn << 6) + 0b111111);
+    }
 
     void iohcRemote1W::cmd(RemoteButton cmd, Tokens* data) {
         if (data->size() == 1) {return; }
@@ -153,37 +142,21 @@ namespace IOHC {
             case RemoteButton::Pair: {
                 // 0x2e: 0x1120 + target broadcast + source + 0x2e00 + sequence + hmac
 
-                std::vector<iohcPacket *> packets2send;
+                std::vector<iohcPacketHandle> packets2send;
 //                for (auto&r: remotes) {
 
-                    auto* packet = new iohcPacket;
-                    packets2send.push_back(packet);
-                    IOHC::iohcRemote1W::forgePacket(packet, r.type[0]);
-                    // Packet length
-                    packet->payload.packet.header.CtrlByte1.asStruct.MsgLen += sizeof(_p0x2e);
-
-                    // Source (me)
-                    for (size_t i = 0; i < sizeof(address); i++)
-                        packet->payload.packet.header.source[i] = r.node[i];
-
-                    //Command
-                    packet->payload.packet.header.cmd = 0x2e;
-                    // Data
-                    packet->payload.packet.msg.p0x2e.data = 0x00;
-                    // Sequence
-                    packet->payload.packet.msg.p0x2e.sequence[0] = r.sequence >> 8;
-                    packet->payload.packet.msg.p0x2e.sequence[1] = r.sequence & 0x00ff;
+                    packets2send.push_back(iohcPacketPool::acquire());
+                    auto *packet = packets2send.back().get();
+                    if (!packet) break;
+                    // Source (me), command, data, then sequence and hmac
+                    const auto frame = forgePacket(packet, r.type[0]).source(r.node).layout(FrameLayoutId::Pair1W)
+                            .sign1W(r.sequence, r.key);
+                    if (frame.truncated()) {
+                        printf("ERROR: %s frame truncated, not sent\n", remoteButtonToString(cmd));
+                        break;
+                    }
                     r.sequence += 1;
                     nvs_write_sequence(r.node, r.sequence);
-                    // hmac
-                    frame = std::vector(&packet->payload.packet.header.cmd, &packet->payload.packet.header.cmd + 2);
-                    uint8_t hmac[16];
-                    iohcCrypto::create_1W_hmac(hmac, packet->payload.packet.msg.p0x2e.sequence, r.key, frame);
-
-                    for (uint8_t i = 0; i < 6; i++)
-                        packet->payload.packet.msg.p0x2e.hmac[i] = hmac[i];
-
-                    packet->buffer_length = packet->payload.packet.header.CtrlByte1.asStruct.MsgLen + 1;
 
                     // if (typn) packet->payload.packet.header.CtrlByte2.asStruct.LPM = 0; //TODO only first is LPM
                     digitalWrite(RX_LED, digitalRead(RX_LED) ^ 1);
@@ -201,38 +174,22 @@ namespace IOHC {
             case RemoteButton::Remove: {
                 // 0x39: 0x1c00 + target broadcast + source + 0x3900 + sequence + hmac
 
-                std::vector<iohcPacket *> packets2send;
+                std::vector<iohcPacketHandle> packets2send;
 //                for (auto&r: remotes) {
 
 
-                    auto* packet = new iohcPacket;
-                    packets2send.push_back(packet);
-                    IOHC::iohcRemote1W::forgePacket(packet, r.type[0]);
-                    // Packet length
-                    //                    packet->payload.packet.header.CtrlByte1.asStruct.MsgLen = sizeof(_header) - 1;
-                    packet->payload.packet.header.CtrlByte1.asStruct.MsgLen += sizeof(_p0x2e);
-
-                    // Source (me)
-                    for (size_t i = 0; i < sizeof(address); i++)
-                        packet->payload.packet.header.source[i] = r.node[i];
-
-                    //Command
-                    packet->payload.packet.header.cmd = 0x39;
-                    // Data
-                    packet->payload.packet.msg.p0x2e.data = 0x00;
-                    // Sequence
-                    packet->payload.packet.msg.p0x2e.sequence[0] = r.sequence >> 8;
-                    packet->payload.packet.msg.p0x2e.sequence[1] = r.sequence & 0x00ff;
+                    packets2send.push_back(iohcPacketPool::acquire());
+                    auto *packet = packets2send.back().get();
+                    if (!packet) break;
+                    // Source (me), command, data, then sequence and hmac
+                    const auto frame = forgePacket(packet, r.type[0]).source(r.node).layout(FrameLayoutId::Unpair1W)
+                            .sign1W(r.sequence, r.key);
+                    if (frame.truncated()) {
+                        printf("ERROR: %s frame truncated, not sent\n", remoteButtonToString(cmd));
+                        break;
+                    }
                     r.sequence += 1;
                     nvs_write_sequence(r.node, r.sequence);
-                    // hmac
-                    uint8_t hmac[16];
-                    frame = std::vector(&packet->payload.packet.header.cmd, &packet->payload.packet.header.cmd + 2);
-                    iohcCrypto::create_1W_hmac(hmac, packet->payload.packet.msg.p0x2e.sequence, r.key, frame);
-                    for (uint8_t i = 0; i < 6; i++)
-                        packet->payload.packet.msg.p0x2e.hmac[i] = hmac[i];
-
-                    packet->buffer_length = packet->payload.packet.header.CtrlByte1.asStruct.MsgLen + 1;
 
                     digitalWrite(RX_LED, digitalRead(RX_LED) ^ 1);
 //                }
@@ -250,39 +207,27 @@ namespace IOHC {
             case RemoteButton::Add: {
                 // 0x30: 0x1100 + target broadcast + source + 0x3000 + ???
 
-                std::vector<iohcPacket *> packets2send;
+                std::vector<iohcPacketHandle> packets2send;
 //                for (auto&r: remotes) {
 
-                    auto* packet = new iohcPacket;
-                    packets2send.push_back(packet);
-                    IOHC::iohcRemote1W::forgePacket(packet, r.type[0]);
-                    // Packet length
-                    packet->payload.packet.header.CtrlByte1.asStruct.MsgLen += sizeof(_p0x30);
-
-                    // Source (me)
-                    for (size_t i = 0; i < sizeof(address); i++)
-                        packet->payload.packet.header.source[i] = r.node[i];
-                    //Command
-                    packet->payload.packet.header.cmd = 0x30;
-
+                    packets2send.push_back(iohcPacketPool::acquire());
+                    auto *packet = packets2send.back().get();
+                    if (!packet) break;
                     // Encrypted key
                     uint8_t encKey[16];
                     memcpy(encKey, r.key, 16);
                     iohcCrypto::encrypt_1W_key(r.node, encKey);
-                    memcpy(packet->payload.packet.msg.p0x30.enc_key, encKey, 16);
-
-                    // Manufacturer
-                    packet->payload.packet.msg.p0x30.man_id = r.manufacturer;
-                    // Data
-                    packet->payload.packet.msg.p0x30.data = 0x01;
-                    // Sequence
-                    packet->payload.packet.msg.p0x30.sequence[0] = r.sequence >> 8;
-                    packet->payload.packet.msg.p0x30.sequence[1] = r.sequence & 0x00ff;
+
+                    // Source (me), command, encrypted key, manufacturer, data, sequence
+                    const auto frame = forgePacket(packet, r.type[0]).source(r.node).command(0x30)
+                            .bytes(encKey, sizeof(encKey)).byte(r.manufacturer).byte(0x01).word(r.sequence);
+                    if (frame.truncated()) {
+                        printf("ERROR: %s frame truncated, not sent\n", remoteButtonToString(cmd));
+                        break;
+                    }
                     r.sequence += 1;
                     nvs_write_sequence(r.node, r.sequence);
 
-                    packet->buffer_length = packet->payload.packet.header.CtrlByte1.asStruct.MsgLen + 1;
-
 
                     digitalWrite(RX_LED, digitalRead(RX_LED) ^ 1);
 //                }
@@ -296,28 +241,27 @@ namespace IOHC {
            default: {
                 // 0x00: 0x1600 + target broadcast + source + 0x00 + Originator + ACEI + Main Param + FP1 + FP2 + sequence + hmac
 
-                std::vector<iohcPacket *> packets2send;
+                std::vector<iohcPacketHandle> packets2send;
 //                for (auto&r: remotes) {
 
-                    auto* packet = new iohcPacket;
-                    packets2send.push_back(packet);
-
-                    IOHC::iohcRemote1W::forgePacket(packet, r.type[0]);
-                    // Packet length
-                    // packet->payload.packet.header.CtrlByte1.asStruct.MsgLen += sizeof(_p0x00);
-                    // Source (me)
-                    for (size_t i = 0; i < sizeof(address); i++)
-                        packet->payload.packet.header.source[i] = r.node[i];
-                    //Command
-                    packet->payload.packet.header.cmd = 0x00;
-                    packet->payload.packet.msg.p0x00_14.origin = 0x01; // Command Source Originator is: 0x01 User
-                    //Acei packet->payload.packet.msg.p0x00.acei;
-                    setAcei(packet->payload.packet.msg.p0x00_14.acei, 0x43); //0xE7); //0x61);
+                    packets2send.push_back(iohcPacketPool::acquire());
+                    auto *packet = packets2send.back().get();
+                    if (!packet) break;
+
+                    // Command variant: 0x01 for the modes, 13 or 16 bytes for the type 0 remotes, 14 otherwise
+                    const bool activate = cmd == RemoteButton::Mode1 || cmd == RemoteButton::Mode2;
+                    FrameLayoutId variant = activate ? FrameLayoutId::Activate1W14 : FrameLayoutId::Execute1W14;
+                    if (r.type[0] == 0 && activate) variant = FrameLayoutId::Activate1W13;
+                    else if (r.type[0] == 0 && cmd == RemoteButton::Mode4) variant = FrameLayoutId::Execute1W16;
+
+                    // Source (me), command and parameters up to the sequence, set below through the layout
+                    auto frame = forgePacket(packet, r.type[0]).source(r.node).layout(variant);
+                    frame.field(FrameField::Origin, 0x01); // Command Source Originator is: 0x01 User
+                    frame.field(FrameField::Acei, 0x43); //0xE7); //0x61);
                     switch (cmd) {
                         // Switch for Main Parameter of cmd 0x00: Open/Close/Stop/Ventilation
                         case RemoteButton::Open:
-                            packet->payload.packet.msg.p0x00_14.main[0] = 0x00;
-                            packet->payload.packet.msg.p0x00_14.main[1] = 0x00;
+                            frame.field(FrameField::Main, 0x0000);
                             r.positionTracker.startOpening();
                             r.movement = remote::Movement::Opening;
                             r.targetPosition = 100.0f;
@@ -332,8 +276,7 @@ namespace IOHC {
 #endif
                             break;
                         case RemoteButton::Close:
-                            packet->payload.packet.msg.p0x00_14.main[0] = 0xc8;
-                            packet->payload.packet.msg.p0x00_14.main[1] = 0x00;
+                            frame.field(FrameField::Main, 0xC800);
                             r.positionTracker.startClosing();
                             r.movement = remote::Movement::Closing;
                             r.targetPosition = 0.0f;
@@ -348,8 +291,7 @@ namespace IOHC {
 #endif
                             break;
                         case RemoteButton::Stop:
-                            packet->payload.packet.msg.p0x00_14.main[0] = 0xd2;
-                            packet->payload.packet.msg.p0x00_14.main[1] = 0x00;
+                            frame.field(FrameField::Main, 0xD200);
                             r.positionTracker.stop();
                             r.movement = remote::Movement::Idle;
                             r.targetPosition = r.positionTracker.getPosition();
@@ -364,20 +306,17 @@ namespace IOHC {
 #endif
                             break;
                         case RemoteButton::Vent:
-                            packet->payload.packet.msg.p0x00_14.main[0] = 0xd8;
-                            packet->payload.packet.msg.p0x00_14.main[1] = 0x03;
+                            frame.field(FrameField::Main, 0xD803);
                             break;
                         case RemoteButton::ForceOpen:
-                            packet->payload.packet.msg.p0x00_14.main[0] = 0x64;
-                            packet->payload.packet.msg.p0x00_14.main[1] = 0x00;
+                            frame.field(FrameField::Main, 0x6400);
                             break;
                         case RemoteButton::Position: {
                             int index = (data->size() > 2) ? 2 : 0;
                             int percent = atoi(data->at(index).c_str());
                             percent = std::clamp(percent, 0, 100);
                             uint8_t val = static_cast<uint8_t>((100 - percent) * 2);
-                            packet->payload.packet.msg.p0x00_14.main[0] = val;
-                            packet->payload.packet.msg.p0x00_14.main[1] = 0x00;
+                            frame.field(FrameField::Main, val << 8);
                             float current = r.positionTracker.getPosition();
                             if (percent > current + 0.5f) {
                                 r.positionTracker.startOpening();
@@ -415,8 +354,7 @@ namespace IOHC {
                             int percent = atoi(data->at(index).c_str());
                             percent = std::clamp(percent, 0, 100);
                             uint16_t val = static_cast<uint16_t>(percent * 0x0200);
-                            packet->payload.packet.msg.p0x00_14.main[0] = val >> 8;
-                            packet->payload.packet.msg.p0x00_14.main[1] = val & 0xFF;
+                            frame.field(FrameField::Main, val);
                             float target = 100.0f - percent;
                             float current = r.positionTracker.getPosition();
                             if (target > current + 0.5f) {
@@ -566,50 +504,11 @@ Every 9 -> 0x20 12:41:28.171 > (23) 1W S 1 E 1  FROM B60D1A TO 00003F CMD 20 <
                     //     // Packet length
                     //     packet->payload.packet.header.CtrlByte1.asStruct.MsgLen += sizeof(_p0x00);
                     // }
-                    // hmac
-                    uint8_t hmac[16];
-                    // frame = std::vector(&packet->payload.packet.header.cmd, &packet->payload.packet.header.cmd + 7);
-                    // + toAdd);
-
-                    if (r.type[0] == 0 && (cmd == RemoteButton::Mode1 ||  cmd == RemoteButton::Mode2)) {
-                        //                        // packet->payload.packet.header.cmd = 0x01;
-                        packet->payload.packet.header.CtrlByte1.asStruct.MsgLen += sizeof(_p0x01_13) ;
-                        //                        // _sequence -= 1; // Use same sequence as light
-                        packet->payload.packet.msg.p0x01_13.sequence[0] = r.sequence >> 8;
-                        packet->payload.packet.msg.p0x01_13.sequence[1] = r.sequence & 0x00ff;
-                        uint8_t toAdd = 5 + 1; // OK
-                        frame = std::vector(&packet->payload.packet.header.cmd, &packet->payload.packet.header.cmd + toAdd);
-                        iohcCrypto::create_1W_hmac(hmac, packet->payload.packet.msg.p0x01_13.sequence, r.key, frame);
-                        for (uint8_t i = 0; i < 6; i++) {
-                            packet->payload.packet.msg.p0x01_13.hmac[i] = hmac[i];
-                        }
-                    }
-
-                    else if (r.type[0] == 0 && (cmd == RemoteButton::Mode4 )) {
-
-                        //                        // packet->payload.packet.header.cmd = 0x01;
-                        packet->payload.packet.header.CtrlByte1.asStruct.MsgLen += sizeof(_p0x00_16) ;
-                        //                        // _sequence -= 1; // Use same sequence as light
-                        packet->payload.packet.msg.p0x00_16.sequence[0] = r.sequence >> 8;
-                        packet->payload.packet.msg.p0x00_16.sequence[1] = r.sequence & 0x00ff;
-                        uint8_t toAdd = 8 + 1;
-                        frame = std::vector(&packet->payload.packet.header.cmd, &packet->payload.packet.header.cmd + toAdd);
-                        iohcCrypto::create_1W_hmac(hmac, packet->payload.packet.msg.p0x00_16.sequence, r.key, frame);
-                        for (uint8_t i = 0; i < 6; i++) {
-                            packet->payload.packet.msg.p0x00_16.hmac[i] = hmac[i];
-                        }
-                    }
-                    else {
-                        packet->payload.packet.header.CtrlByte1.asStruct.MsgLen += sizeof(_p0x00_14) ;
-                        // Sequence
-                        packet->payload.packet.msg.p0x00_14.sequence[0] = r.sequence >> 8;
-                        packet->payload.packet.msg.p0x00_14.sequence[1] = r.sequence & 0x00ff;
-                        uint8_t toAdd =  6 + 1; //OK
-                        frame = std::vector(&packet->payload.packet.header.cmd, &packet->payload.packet.header.cmd + toAdd);
-                        iohcCrypto::create_1W_hmac(hmac, packet->payload.packet.msg.p0x00_14.sequence, r.key, frame);
-                        for (uint8_t i = 0; i < 6; i++) {
-                            packet->payload.packet.msg.p0x00_14.hmac[i] = hmac[i];
-                        }
+                    // Sequence and hmac after the parameters of the layout
+                    frame.sign1W(r.sequence, r.key);
+                    if (frame.truncated()) {
+                        printf("ERROR: %s frame truncated, not sent\n", remoteButtonToString(cmd));
+                        break;
                     }
                     /*
                                         if (r.type == 0xff) {
@@ -621,19 +520,12 @@ Every 9 -> 0x20 12:41:28.171 > (23) 1W S 1 E 1  FROM B60D1A TO 00003F CMD 20 <
                     */
                     r.sequence += 1;
                     nvs_write_sequence(r.node, r.sequence);
-                    // hmac
-                    // uint8_t hmac[16];
-                    // frame = std::vector(&packet->payload.packet.header.cmd, &packet->payload.packet.header.cmd + 7 + toAdd);
-                    // iohcCrypto::create_1W_hmac(hmac, packet->payload.packet.msg.p0x00.sequence, _key, frame);
-                    // for (uint8_t i = 0; i < 6; i++) {
-                    //     packet->payload.packet.msg.p0x00.hmac[i] = hmac[i];
-                    //     packet->payload.packet.msg.p0x00_all.hmac[i] = hmac[i];
-                    // }
-                    packet->buffer_length = packet->payload.packet.header.CtrlByte1.asStruct.MsgLen + 1;
 
                     digitalWrite(RX_LED, digitalRead(RX_LED) ^ 1);
 
-                    _radioInstance->send(packets2send);
+                    // A newer command for this remote supersedes one still waiting in the queue
+                    _radioInstance->send(packets2send, TxPriority::Interactive,
+                                         iohcRadio::coalesceKey(TxCoalesce::Remote1W, r.node));
 
                     display1WAction(r.node, remoteButtonToString(cmd), "TX", r.name.c_str());
                     Serial.printf("%s position: %.0f%%\n", r.name.c_str(), r.positionTracker.getPosition());
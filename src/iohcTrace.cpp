@@ -0,0 +1,123 @@
+/*
+   Copyright (c) 2024. CRIDP https://github.com/cridp
+
+   Licensed under the Apache License, Version 2.0 (the "License");
+   you may not use this file except in compliance with the License.
+   You may obtain a copy of the License at
+
+           http://www.apache.org/licenses/LICENSE-2.0
+
+   Unless required by applicable law or agreed to in writing, software
+   distributed under the License is distributed on an "AS IS" BASIS,
+   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+   See the License for the specific language governing permissions and
+   limitations under the License.
+ */
+
+
+#include <cstdio>
+#include "esp_timer.h"
+
+#include <iohcTrace.h>
+#include <iohcRadio.h>
+
+namespace IOHC {
+    static_assert((TRACE_ENTRIES & (TRACE_ENTRIES - 1)) == 0, "TRACE_ENTRIES must be a power of two");
+
+    iohcTrace::entry iohcTrace::entries[TRACE_ENTRIES]{};
+    std::atomic<uint32_t> iohcTrace::head{0};
+
+    static const char *const traceNames[] = {
+        "IRQ", "STATE", "PREAMBLE", "TX_QUEUED", "TX_COALESCED", "TX_PREPARE", "TX_BACKOFF", "TX_SENT",
+        "TX_REPEAT", "TX_NEXT", "TX_WAITING", "TX_DONE_BY_REG", "TX_PREEMPTED", "TX_BATCH_DONE"
+    };
+    static_assert(sizeof(traceNames) / sizeof(traceNames[0]) == static_cast<size_t>(TraceEvent::Count),
+                  "traceNames must follow TraceEvent");
+
+/**
+ * The `record` function appends an event. Safe from ISR, timer and task context on both cores: the
+ * slot is claimed with a single atomic increment and nothing waits on a lock or the UART.
+ */
+    void IRAM_ATTR iohcTrace::record(TraceEvent event, uint32_t a, uint32_t b) {
+        const uint32_t idx = head.fetch_add(1, std::memory_order_relaxed);
+        entry &e = entries[idx & (TRACE_ENTRIES - 1)];
+        e.seq.store(0, std::memory_order_relaxed);
+        std::atomic_thread_fence(std::memory_order_release);
+        e.us = static_cast<uint32_t>(esp_timer_get_time());
+        e.a = a;
+        e.b = b;
+        e.event = event;
+        e.seq.store(idx + 1, std::memory_order_release);
+    }
+
+    void iohcTrace::clear() {
+        for (auto &e : entries) e.seq.store(0, std::memory_order_relaxed);
+        head.store(0, std::memory_order_relaxed);
+    }
+
+    uint32_t iohcTrace::first(size_t last) {
+        const uint32_t end = head.load(std::memory_order_acquire);
+        size_t count = last < TRACE_ENTRIES ? last : TRACE_ENTRIES;
+        if (count > end) count = end;
+        return end - count;
+    }
+
+/**
+ * The `read` function copies event `idx` out of the ring.
+ *
+ * @return false when the slot was overwritten by a newer event or is being written.
+ */
+    bool iohcTrace::read(uint32_t idx, copy &out) {
+        const entry &e = entries[idx & (TRACE_ENTRIES - 1)];
+        if (e.seq.load(std::memory_order_acquire) != idx + 1) return false;
+        out.us = e.us;
+        out.a = e.a;
+        out.b = e.b;
+        out.event = e.event;
+        std::atomic_thread_fence(std::memory_order_acquire);
+        return e.seq.load(std::memory_order_relaxed) == idx + 1;
+    }
+
+    void iohcTrace::dump(size_t last) {
+        const uint32_t end = head.load(std::memory_order_acquire);
+        uint32_t prevUs = 0;
+        bool havePrev = false;
+        printf("%u events recorded, showing up to %u\n", static_cast<unsigned>(end),
+               static_cast<unsigned>(last < TRACE_ENTRIES ? last : TRACE_ENTRIES));
+        printf("      Time(us)    +Delta  Event           Args\n");
+        for (uint32_t idx = first(last); idx != end; idx++) {
+            copy c{};
+            if (!read(idx, c)) continue;
+            const uint32_t delta = havePrev ? c.us - prevUs : 0;
+            prevUs = c.us;
+            havePrev = true;
+            printf("%14u %9u  %-15s ", static_cast<unsigned>(c.us), static_cast<unsigned>(delta),
+                   traceNames[static_cast<uint8_t>(c.event)]);
+            switch (c.event) {
+                case TraceEvent::State:
+                case TraceEvent::TxWaiting:
+                    printf("%s\n", iohcRadio::radioStateToString(static_cast<iohcRadio::RadioState>(c.a)));
+                    break;
+                case TraceEvent::TxCoalesced:
+                    printf("class=%u key=%06x\n", static_cast<unsigned>(c.a), static_cast<unsigned>(c.b));
+                    break;
+                default:
+                    printf("%u %u\n", static_cast<unsigned>(c.a), static_cast<unsigned>(c.b));
+                    break;
+            }
+        }
+    }
+
+    void iohcTrace::toJson(JsonArray &root, size_t last) {
+        const uint32_t end = head.load(std::memory_order_acquire);
+        for (uint32_t idx = first(last); idx != end; idx++) {
+            copy c{};
+            if (!read(idx, c)) continue;
+            JsonObject obj = root.add<JsonObject>();
+            obj["us"] = c.us;
+            obj["event"] = traceNames[static_cast<uint8_t>(c.event)];
+            obj["a"] = c.a;
+            obj["b"] = c.b;
+        }
+    }
+}
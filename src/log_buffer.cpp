@@ -1,4 +1,4 @@
-#include <deque>
+#include <cstring>
 #include <vector>
 #include <Arduino.h>
 #include <log_buffer.h>
@@ -12,15 +12,21 @@
 #endif
 
 namespace {
-    std::deque<String> logDeque;
     const size_t MAX_LOG_ENTRIES = 50;
+    // Fixed lines written for every frame, only the web pages copy them into Strings
+    char logLines[MAX_LOG_ENTRIES][LOG_LINE_LEN];
+    size_t logHead = 0;     // Next line written
+    size_t logCount = 0;
+    portMUX_TYPE logMux = portMUX_INITIALIZER_UNLOCKED;
 }
 
-void addLogMessage(const String &msg) {
-    if (logDeque.size() >= MAX_LOG_ENTRIES) {
-        logDeque.pop_front();
-    }
-    logDeque.push_back(msg);
+void addLogMessage(const char *msg) {
+    portENTER_CRITICAL(&logMux);
+    strncpy(logLines[logHead], msg, LOG_LINE_LEN - 1);
+    logLines[logHead][LOG_LINE_LEN - 1] = '\0';
+    logHead = (logHead + 1) % MAX_LOG_ENTRIES;
+    if (logCount < MAX_LOG_ENTRIES) logCount++;
+    portEXIT_CRITICAL(&logMux);
 #if defined(WEBSERVER)
     //broadcastLog(msg);
 #endif
@@ -29,6 +35,23 @@ void addLogMessage(const String &msg) {
 #endif
 }
 
+void addLogMessage(const String &msg) {
+    addLogMessage(msg.c_str());
+}
+
 std::vector<String> getLogMessages() {
-    return std::vector<String>(logDeque.begin(), logDeque.end());
+    std::vector<String> messages;
+    messages.reserve(MAX_LOG_ENTRIES);
+    char line[LOG_LINE_LEN];
+    for (size_t i = 0; ; i++) {
+        portENTER_CRITICAL(&logMux);
+        if (i >= logCount) {
+            portEXIT_CRITICAL(&logMux);
+            break;
+        }
+        memcpy(line, logLines[(logHead + MAX_LOG_ENTRIES - logCount + i) % MAX_LOG_ENTRIES], LOG_LINE_LEN);
+        portEXIT_CRITICAL(&logMux);
+        messages.emplace_back(line);
+    }
+    return messages;
 }
@@ -29,6 +29,7 @@
 #include <iohcCozyDevice2W.h>
 #include <iohcOtherDevice2W.h>
 #include <iohcRemoteMap.h>
+#include <iohcFrameLayout.h>
 #include <interact.h>
 #if defined(MQTT)
 #include <mqtt_handler.h>
@@ -131,7 +132,7 @@ void setup() {
     otherDevice2W = IOHC::iohcOtherDevice2W::getInstance();
     remoteMap = IOHC::iohcRemoteMap::getInstance();
 
-    //   AES_init_ctx(&ctx, transfert_key); // PreInit AES for cozy (1W use original version) TODO
+    iohcCrypto::aesSelfTest();
 
     Cmd::createCommands();
 
@@ -148,42 +149,6 @@ void setup() {
     digitalWrite(RX_LED, digitalRead(RX_LED) ^ 1);
 }
 
-/**
- * The function `forgePacket` modifies a given `iohcPacket` structure with specific values and
- * settings.
- * 
- * @param packet The `packet` parameter is a pointer to an `iohcPacket` struct.
- * @param toSend The `vector` parameter in the `forgePacket` function is a `std::vector<uint8_t>` type,
- * which is a standard C++ container that stores a sequence of elements of type `uint8_t` (unsigned
- * 8-bit integer). In this function, the size of the `
- */
-/**
-* @brief Creates a iohcPacket with the given data to send. 
-* @param packet * The packet you want to forge
-* @param toSend The data that will be added to the packet
-*/
-void IRAM_ATTR forgePacket(iohcPacket* packet, const std::vector<uint8_t> &toSend) {
-    digitalWrite(RX_LED, digitalRead(RX_LED) ^ 1);
-    IOHC::packetStamp = esp_timer_get_time();
-
-    // Common Flags
-    // 8 if protocol version is 0 else 10
-    packet->payload.packet.header.CtrlByte1.asStruct.MsgLen = sizeof(_header) - 1;
-    packet->payload.packet.header.CtrlByte1.asStruct.Protocol = 0;
-    packet->payload.packet.header.CtrlByte1.asStruct.StartFrame = 1;
-    packet->payload.packet.header.CtrlByte1.asStruct.EndFrame = 0;
-    packet->payload.packet.header.CtrlByte1.asByte += toSend.size();
-    memcpy(packet->payload.buffer + 9, toSend.data(), toSend.size());
-    packet->buffer_length = toSend.size() + 9;
-
-    packet->payload.packet.header.CtrlByte2.asByte = 0;
-
-    packet->frequency = CHANNEL2;
-    packet->repeatTime = 25;
-    packet->repeat = 0;
-    packet->lock = false;
-}
-
 bool msgRcvd(IOHC::iohcPacket *iohc) {
     JsonDocument doc;
     doc["type"] = "Unk";
@@ -219,8 +184,9 @@ bool msgRcvd(IOHC::iohcPacket *iohc) {
             // 0x0b OverKiz 0x0c Atlantic
             std::vector<uint8_t> toSend = {0xff, 0xc0, 0xba, 0x11, 0xad, 0x0b, 0xcc, 0x00, 0x00};
 
-            auto* packet = new iohcPacket;
-            forgePacket(packet, toSend);
+            auto packet = iohcPacketPool::acquire(true);
+            if (!packet) break;
+            if (!iohcCozyDevice2W::forgePacket(packet.get(), toSend)) break;
 
             packet->payload.packet.header.cmd = IOHC::iohcDevice::SEND_DISCOVER_ANSWER_0x29;
  
@@ -232,7 +198,7 @@ bool msgRcvd(IOHC::iohcPacket *iohc) {
             packet->repeat = 0;
 
             digitalWrite(RX_LED, digitalRead(RX_LED) ^ 1);
-            radioInstance->send(packet);
+            radioInstance->send(std::move(packet), TxPriority::Reply);
             break;
         }
         case iohcDevice::RECEIVED_DISCOVER_ANSWER_0x29: {
@@ -252,8 +218,9 @@ bool msgRcvd(IOHC::iohcPacket *iohc) {
             // std::vector<uint8_t> toSend = {0x01, 0x02, 0x03, 0x04, 0x05, 0x06}; // 38
             std::vector<uint8_t> toSend = {}; // SEND_DISCOVER_ACTUATOR_0x2C
 
-            auto* packet = new iohcPacket;
-            forgePacket(packet, toSend);
+            auto packet = iohcPacketPool::acquire(true);
+            if (!packet) break;
+            if (!iohcCozyDevice2W::forgePacket(packet.get(), toSend)) break;
 
             // packet->payload.packet.header.cmd = 0x38;
             packet->payload.packet.header.cmd = iohcDevice::SEND_DISCOVER_ACTUATOR_0x2C;
@@ -266,7 +233,7 @@ bool msgRcvd(IOHC::iohcPacket *iohc) {
 
             packet->repeat = 1;
 
-            radioInstance->send(packet);
+            radioInstance->send(std::move(packet), TxPriority::Reply);
             digitalWrite(RX_LED, digitalRead(RX_LED) ^ 1);
             break;
         }
@@ -282,8 +249,9 @@ bool msgRcvd(IOHC::iohcPacket *iohc) {
 
             std::vector<uint8_t> toSend = {};
 
-            auto* packet = new iohcPacket;
-            forgePacket(packet, toSend);
+            auto packet = iohcPacketPool::acquire(true);
+            if (!packet) break;
+            if (!iohcCozyDevice2W::forgePacket(packet.get(), toSend)) break;
 
             packet->payload.packet.header.cmd = IOHC::iohcDevice::SEND_DISCOVER_ACTUATOR_ACK_0x2D;
 
@@ -294,7 +262,7 @@ bool msgRcvd(IOHC::iohcPacket *iohc) {
             packet->delayed = 250;
             packet->repeat = 0;
 
-            radioInstance->send(packet);
+            radioInstance->send(std::move(packet), TxPriority::Reply);
             digitalWrite(RX_LED, digitalRead(RX_LED) ^ 1);
             break;
         }
@@ -318,9 +286,8 @@ bool msgRcvd(IOHC::iohcPacket *iohc) {
             }
             printf("\n");
 
-            AES_init_ctx(&ctx, transfert_key);
             uint8_t encrypted_key[16];
-            AES_ECB_encrypt(&ctx, initial_value);
+            iohcCrypto::aes128Encrypt(transfert_key, initial_value, initial_value);
             //  XORing transfert_key
             for (int i = 0; i < 16; i++) {
                 encrypted_key[i] = initial_value[i] ^ transfert_key[i];
@@ -333,8 +300,9 @@ bool msgRcvd(IOHC::iohcPacket *iohc) {
             std::vector<uint8_t> toSend;
             toSend.assign(encrypted_key, encrypted_key + 16);
 
-            auto* packet = new iohcPacket;
-            forgePacket(packet, toSend);
+            auto packet = iohcPacketPool::acquire(true);
+            if (!packet) break;
+            if (!iohcCozyDevice2W::forgePacket(packet.get(), toSend)) break;
 
             packet->payload.packet.header.cmd = IOHC::iohcDevice::SEND_KEY_TRANSFERT_0x32;
             cozyDevice2W->memorizeSend.memorizedCmd = IOHC::iohcDevice::SEND_KEY_TRANSFERT_0x32;
@@ -345,7 +313,7 @@ bool msgRcvd(IOHC::iohcPacket *iohc) {
 
             packet->repeat = 0;
 
-            radioInstance->send(packet);
+            radioInstance->send(std::move(packet), TxPriority::Reply);
             digitalWrite(RX_LED, digitalRead(RX_LED) ^ 1);
             break;
         }
@@ -375,8 +343,6 @@ bool msgRcvd(IOHC::iohcPacket *iohc) {
 //                if (!cozyDevice2W->isFake(iohc->payload.packet.header.source, iohc->payload.packet.header.target)) {
                     //                        AES_init_ctx(&ctx, setgo); // PreInit AES for other2W (1W use original version) TODO
 //                }
-                //                    else
-                AES_init_ctx(&ctx, transfert_key);
 
                 // IVdata is the challenge with commandId put on start
                 std::vector<uint8_t> challengeAsked;
@@ -393,13 +359,14 @@ bool msgRcvd(IOHC::iohcPacket *iohc) {
                 std::vector<uint8_t> IVdata = cozyDevice2W->memorizeSend.memorizedData;
                 IVdata.insert(IVdata.begin(), cozyDevice2W->memorizeSend.memorizedCmd);
 
-                auto* packet = new iohcPacket;
+                auto packet = iohcPacketPool::acquire(true);
+                if (!packet) break;
 
                 packet->payload.packet.header.cmd = IOHC::iohcDevice::SEND_CHALLENGE_ANSWER_0x3D;
 
                 unsigned char initial_value[16];
                 constructInitialValue(IVdata, initial_value, IVdata.size(), challengeAsked, nullptr);
-                AES_ECB_encrypt(&ctx, initial_value);
+                iohcCrypto::aes128Encrypt(transfert_key, initial_value, initial_value);
                 uint8_t dataLen = 6;
 
                 if (cozyDevice2W->memorizeSend.memorizedCmd == IOHC::iohcDevice::RECEIVED_ASK_CHALLENGE_0x31) {
@@ -407,7 +374,7 @@ bool msgRcvd(IOHC::iohcPacket *iohc) {
                     dataLen = 16;
                     IVdata = {IOHC::iohcDevice::RECEIVED_ASK_CHALLENGE_0x31};
                     constructInitialValue(IVdata, initial_value, 1, challengeAsked, nullptr);
-                    AES_ECB_encrypt(&ctx, initial_value);
+                    iohcCrypto::aes128Encrypt(transfert_key, initial_value, initial_value);
                     for (int i = 0; i < dataLen; i++)
                         initial_value[i] = initial_value[i] ^ transfert_key[i];
                     cozyDevice2W->memorizeSend.memorizedCmd = IOHC::iohcDevice::SEND_KEY_TRANSFERT_0x32;
@@ -416,7 +383,7 @@ bool msgRcvd(IOHC::iohcPacket *iohc) {
 
                 std::vector<uint8_t> toSend;
                 toSend.assign(initial_value, initial_value + dataLen);
-                forgePacket(packet, toSend);
+                if (!iohcCozyDevice2W::forgePacket(packet.get(), toSend)) break;
 
                 /* Swap */
                 memcpy(packet->payload.packet.header.source, iohc->payload.packet.header.target, 3);
@@ -425,8 +392,6 @@ bool msgRcvd(IOHC::iohcPacket *iohc) {
                 packet->repeatTime = 6;
                 packet->repeat = 1;
 
-                radioInstance->send(packet);
-
                 // Serial.print("IV used for key encryption: ");
                 // for (int i = 0; i < 16; i++)
                 //     Serial.printf("%02X ", initial_value[i]);
@@ -435,6 +400,7 @@ bool msgRcvd(IOHC::iohcPacket *iohc) {
                 for (int i = 0; i < dataLen; i++)
                     printf("%02X ", initial_value[i]);
                 printf("\n");
+                radioInstance->send(std::move(packet), TxPriority::Reply);
 
                 //                sysTable->addObject(iohc);
                 digitalWrite(RX_LED, digitalRead(RX_LED) ^ 1);
@@ -447,7 +413,10 @@ bool msgRcvd(IOHC::iohcPacket *iohc) {
         case 0x19: {
             if (iohc->payload.packet.header.CtrlByte1.asStruct.Protocol == 1 && iohc->payload.packet.header.cmd == 0x00) {
                 doc["type"] = "1W";
-                uint16_t main = (iohc->payload.packet.msg.p0x00_14.main[0] << 8) | iohc->payload.packet.msg.p0x00_14.main[1];
+                // Only the two byte main parameter of the 14 and 16 byte layouts carries a position command
+                uint32_t main;
+                uint8_t mainSize;
+                if (!IOHC::frameField(iohc, IOHC::FrameField::Main, main, &mainSize) || mainSize != 2) main = 0xFFFF;
                 const char *action = "unknown";
                 switch (main) {
                     case 0x0000: action = "OPEN"; break;
@@ -484,9 +453,10 @@ bool msgRcvd(IOHC::iohcPacket *iohc) {
             std::vector<uint8_t> toSend = {0x4d, 0x59, 0x5f, 0x47, 0x41, 0x54, 0x45, 0x57, 0x41, 0x59};
             toSend.resize(16);
             
-            auto* packet = new iohcPacket;
+            auto packet = iohcPacketPool::acquire(true);
+            if (!packet) break;
 
-            forgePacket(packet, toSend);
+            if (!iohcCozyDevice2W::forgePacket(packet.get(), toSend)) break;
 
             packet->payload.packet.header.cmd = 0x51;
 
@@ -497,7 +467,7 @@ bool msgRcvd(IOHC::iohcPacket *iohc) {
             packet->delayed = 50;
             packet->repeat = 0;
 
-            radioInstance->send(packet);
+            radioInstance->send(std::move(packet), TxPriority::Reply);
             digitalWrite(RX_LED, digitalRead(RX_LED) ^ 1);
             }
             break;
@@ -555,9 +525,8 @@ bool msgRcvd(IOHC::iohcPacket *iohc) {
         case 0x39: {
             if (keyCap[0] == 0) break;
             uint8_t hmac[16];
-            std::vector<uint8_t> frame(&iohc->payload.packet.header.cmd, &iohc->payload.packet.header.cmd + 2);
-            // frame = {0x39, 0x00}; //
-            iohcCrypto::create_1W_hmac(hmac, iohc->payload.packet.msg.p0x39.sequence, keyCap, frame);
+            // Signed: command and data, {0x39, 0x00}
+            iohcCrypto::create_1W_hmac(hmac, iohc->payload.packet.msg.p0x39.sequence, keyCap, &iohc->payload.packet.header.cmd, 2);
             printf("MAC: ");
             for (uint8_t idx = 0; idx < 6; idx++)
                 printf("%2.2X", hmac[idx]);
@@ -605,9 +574,10 @@ bool publishMsg(IOHC::iohcPacket *iohc) {
 
     if (iohc->payload.packet.header.CtrlByte1.asStruct.Protocol == 1 &&
         iohc->payload.packet.header.cmd == 0x00) {
-        uint16_t main =
-                (iohc->payload.packet.msg.p0x00_14.main[0] << 8) |
-                iohc->payload.packet.msg.p0x00_14.main[1];
+        // Only the two byte main parameter of the 14 and 16 byte layouts carries a position command
+        uint32_t main;
+        uint8_t mainSize;
+        if (!IOHC::frameField(iohc, IOHC::FrameField::Main, main, &mainSize) || mainSize != 2) main = 0xFFFF;
         const char *action = "unknown";
         switch (main) {
             case 0x0000: action = "open"; break;
@@ -627,6 +597,7 @@ bool publishMsg(IOHC::iohcPacket *iohc) {
     mqttClient.publish("iown/Frame", 1, false, message.c_str(), messageSize);
     mqttClient.publish((mqtt_discovery_topic + "/sensor/iohc_frame/state").c_str(), 0, false, message.c_str(), messageSize);
 #endif
+    iohc->publishedStamp = esp_timer_get_time();
     return false;
 }
 
@@ -691,7 +662,8 @@ void txUserBuffer(Tokens *cmd) {
         return;
     }
     digitalWrite(RX_LED, digitalRead(RX_LED) ^ 1);
-    auto *packet = new iohcPacket;
+    auto packet = iohcPacketPool::acquire();
+    if (!packet) return;
 
     if (cmd->size() == 3)
         packet->frequency = frequencies[atoi(cmd->at(2).c_str()) - 1];
@@ -702,7 +674,11 @@ void txUserBuffer(Tokens *cmd) {
     packet->repeatTime = 35;
     packet->repeat = 1;
 
-    radioInstance->send(packet);
+    radioInstance->send(std::move(packet), TxPriority::Interactive, 0, [](const TxReport &report) {
+        printf("TX request %u done: on air after %ums, last repeat after %ums\n", static_cast<unsigned>(report.id),
+               static_cast<unsigned>((report.firstAirUs - report.queuedUs) / 1000),
+               static_cast<unsigned>((report.doneUs - report.queuedUs) / 1000));
+    });
     digitalWrite(RX_LED, digitalRead(RX_LED) ^ 1);
 }
 
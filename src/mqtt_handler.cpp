@@ -220,6 +220,24 @@ void publishHeartbeat() {
     mqttClient.publish(AVAILABILITY_TOPIC, 0, true, "online");
 }
 
+void publishLinkStats() {
+    JsonDocument doc;
+    JsonArray devices = doc.to<JsonArray>();
+    IOHC::iohcRadio::getInstance()->linkStats.toJson(devices);
+    std::string payload;
+    size_t len = serializeJson(doc, payload);
+    mqttClient.publish("iown/linkstats", 0, false, payload.c_str(), len);
+}
+
+void publishDutyCycle() {
+    JsonDocument doc;
+    JsonArray bands = doc.to<JsonArray>();
+    IOHC::iohcRadio::getInstance()->dutyCycle.toJson(bands);
+    std::string payload;
+    size_t len = serializeJson(doc, payload);
+    mqttClient.publish("iown/dutycycle", 0, false, payload.c_str(), len);
+}
+
 void publishCoverState(const std::string &id, const char *state) {
     std::string topic = "iown/" + id + "/state";
     mqttClient.publish(topic.c_str(), 0, true, state);
@@ -349,6 +367,8 @@ static void mqttSchedulerTask(void*) {
             s_nextHeartbeatAtMs.store(now + 60000UL);
             if (mqttStatus == ConnState::Connected && mqttClient.connected()) {
                 publishHeartbeat();
+                publishLinkStats();
+                publishDutyCycle();
             }
         }
     }
@@ -20,6 +20,8 @@
 #define SYSLOG_APP "MIOPENIO"        // rsyslog will use this as %PROGRAMNAME%
 #endif
 
+#define SYSLOG_WIRE_LEN 480          // Header and message, longer messages are truncated
+
 // Define SYSLOG_RFC5424 to send RFC5424 instead of RFC3164
 // #define SYSLOG_RFC5424
 
@@ -92,10 +94,13 @@ namespace {
     }
 #endif
 
-    String currentHostIdent() {
+    // Hostname, else the IP address written into `buf`
+    const char *currentHostIdent(char *buf, size_t size) {
         const char *h = WiFi.getHostname();
-        if (h && *h) return String(h);
-        return WiFi.localIP().toString();
+        if (h && *h) return h;
+        const IPAddress ip = WiFi.localIP();
+        snprintf(buf, size, "%u.%u.%u.%u", ip[0], ip[1], ip[2], ip[3]);
+        return buf;
     }
 }
 
@@ -141,7 +146,7 @@ void initSyslog() {
 }
 
 // Real sender with RFC header
-void sendSyslog(const String &msg, int severity) {
+void sendSyslog(const char *msg, int severity) {
     ensureConfigLoaded();
     if (!syslog_enabled) {
         return;
@@ -158,27 +163,38 @@ void sendSyslog(const String &msg, int severity) {
         return;
     }
 
-    const int p     = pri(SYSLOG_FACILITY, severity);
-    const String base = currentHostIdent();
-    const String ho = syslog_tag.empty() ? base : (syslog_tag.c_str() + String("-") + base);
+    const int p = pri(SYSLOG_FACILITY, severity);
+    char ip[16];
+    const char *base = currentHostIdent(ip, sizeof(ip));
 
     // No timestamp — device has no NTP so Jan 1 epoch would be rejected by syslog servers.
     // The receiver timestamps the message on arrival instead.
-    const String header = "<" + String(p) + ">" + ho + " " + SYSLOG_APP + ": ";
-    const String wire   = header + "[" SYSLOG_SECRET "] " + msg;
+    char wire[SYSLOG_WIRE_LEN];
+    int len = snprintf(wire, sizeof(wire), "<%d>%s%s%s " SYSLOG_APP ": [" SYSLOG_SECRET "] %s", p,
+                       syslog_tag.c_str(), syslog_tag.empty() ? "" : "-", base, msg);
+    if (len < 0) return;
+    if (static_cast<size_t>(len) >= sizeof(wire)) len = sizeof(wire) - 1;
 
-    ESP_LOGD(TAG, "Sending syslog (len=%u): %s", wire.length(), wire.c_str());
+    ESP_LOGD(TAG, "Sending syslog (len=%d): %s", len, wire);
     syslogUdp.beginPacket(syslogIP, syslog_port);
-    syslogUdp.write(reinterpret_cast<const uint8_t*>(wire.c_str()), wire.length());
+    syslogUdp.write(reinterpret_cast<const uint8_t*>(wire), len);
     int result = syslogUdp.endPacket();
     ESP_LOGD(TAG, "Message send result: %d", result);
 }
 
+void sendSyslog(const String &msg, int severity) {
+    sendSyslog(msg.c_str(), severity);
+}
+
 // Legacy overload without severity (defaults to info)
-void sendSyslog(const String &msg) {
+void sendSyslog(const char *msg) {
     sendSyslog(msg, 6);
 }
 
+void sendSyslog(const String &msg) {
+    sendSyslog(msg.c_str(), 6);
+}
+
 void resetSyslog() {
     if (syslogReady) {
         syslogUdp.stop();
@@ -191,6 +207,8 @@ void resetSyslog() {
 // No-op definitions so you can build without SYSLOG
 void initSyslog() {}
 void resetSyslog() {}
+void sendSyslog(const char *) {}
+void sendSyslog(const char *, int) {}
 void sendSyslog(const String &) {}
 void sendSyslog(const String &, int) {}
 
@@ -16,6 +16,7 @@
 #include <iohcRemote1W.h>
 #include <iohcRemoteMap.h>
 #include <iohcPacket.h>
+#include <iohcTrace.h>
 #include <log_buffer.h>
 #include <mqtt_handler.h>
 #include <nvs_helpers.h>
@@ -415,6 +416,35 @@ void handleApiLastAddr(AsyncWebServerRequest *request, JsonObject &root) {
   root["address"] = bytesToHexString(IOHC::lastFromAddress, sizeof(IOHC::lastFromAddress)).c_str();
 }
 
+static void latencyToJson(JsonObject obj, const IOHC::iohcLatencyHistogram &histogram) {
+  obj["count"] = histogram.count();
+  obj["p50"] = histogram.percentile(50);
+  obj["p90"] = histogram.percentile(90);
+  obj["p99"] = histogram.percentile(99);
+  obj["max"] = histogram.max();
+}
+
+void handleApiLatency(AsyncWebServerRequest *request, JsonObject &root) {
+  const auto &latency = IOHC::iohcRadio::getInstance()->rxLatency;
+  latencyToJson(root["isrToQueued"].to<JsonObject>(), latency.isrToQueued);
+  latencyToJson(root["queuedToDispatched"].to<JsonObject>(), latency.queuedToDispatched);
+  latencyToJson(root["dispatchedToPublished"].to<JsonObject>(), latency.dispatchedToPublished);
+  latencyToJson(root["isrToPublished"].to<JsonObject>(), latency.isrToPublished);
+}
+
+void handleApiLinkStats(AsyncWebServerRequest *request, JsonArray &root) {
+  IOHC::iohcRadio::getInstance()->linkStats.toJson(root);
+}
+
+void handleApiTrace(AsyncWebServerRequest *request, JsonArray &root) {
+  size_t last = TRACE_ENTRIES;
+  if (request->hasParam("last")) {
+    const long wanted = request->getParam("last")->value().toInt();
+    if (wanted > 0) last = static_cast<size_t>(wanted);
+  }
+  IOHC::iohcTrace::toJson(root, last);
+}
+
 static bool jsonToBool(JsonVariant variant, bool &value) {
   if (variant.is<bool>()) {
     value = variant.as<bool>();
@@ -766,6 +796,9 @@ void setupWebServer() {
   server.on("/api/remotes", HTTP_GET, jsonGet(handleApiRemotes));
   server.on("/api/logs", HTTP_GET, jsonGet(handleApiLogs));
   server.on("/api/lastaddr", HTTP_GET, jsonGet(handleApiLastAddr));
+  server.on("/api/latency", HTTP_GET, jsonGet(handleApiLatency));
+  server.on("/api/linkstats", HTTP_GET, jsonGet(handleApiLinkStats));
+  server.on("/api/trace", HTTP_GET, jsonGet(handleApiTrace));
 #if defined(SSD1306_DISPLAY)
   server.on("/api/display", HTTP_GET, jsonGet(handleApiDisplayGet));
 #endif